@@ -0,0 +1,25 @@
+module OLED
+  class Chart
+    # mode: :sweep (default) or :scroll, series: number of the lines,
+    # range: [min, max] for a fixed range, the range follows the samples
+    # without it.
+    def initialize(display, x, y, w, h, options = {})
+      # sweep sends 2 columns per sample, scroll the whole plot area
+      mode = (options[:mode] == :scroll) ? SCROLL : SWEEP
+      _init(display, x, y, w, h, options[:series] || 1, mode)
+      range(*options[:range]) if options[:range]
+    end
+
+    # Append a sample of each series, shown by flush
+    def push(*values)
+      _push(values)
+    end
+
+    # Append a sample of the single series, and show it
+    def <<(value)
+      _push([value])
+      flush
+      self
+    end
+  end
+end
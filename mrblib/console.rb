@@ -0,0 +1,31 @@
+module OLED
+  class Console
+    # flush after every print / puts if true
+    attr_accessor :sync
+
+    def print(*args)
+      args.each { |a| write(a.to_s) }
+      flush unless @sync == false
+      nil
+    end
+
+    def puts(*args)
+      if args.empty?
+        write("\n")
+      else
+        args.each do |a|
+          s = a.to_s
+          write(s)
+          write("\n") unless s[-1] == "\n"
+        end
+      end
+      flush unless @sync == false
+      nil
+    end
+
+    def <<(obj)
+      print(obj)
+      self
+    end
+  end
+end
@@ -1,12 +1,118 @@
 module OLED
-  class SSD1306SPI
+  # Display of any bus, opened by the subclass of the bus
+  class SSD1306
     attr_accessor :color
     attr_accessor :fontsize
 
     include Constants
     def initialize(options={})
+      open(options)
+    end
+
+    # Initialize the display, also opens it again after close.
+    # The bus is shared by the displays, and freed after the last close.
+    def open(options={})
       @color = options[:color] || OLED::WHITE
       @fontsize = options[:fontsize] || 1
+      @width = options[:width] || WIDTH
+      @height = options[:height] || HEIGHT
+      @controller = options[:controller] || Constants::SSD1306
+      @col_offset = options[:col_offset] || COL_OFFSET_AUTO
+
+      _open(options)
+      self.rotation = options[:rotation] if options[:rotation]
+      self.invert = options[:invert] if options[:invert]
+      self.timeout = options[:timeout] if options[:timeout]
+      set_retry(options[:retries], options[:retry_backoff] || 10) if options[:retries]
+      self
+    end
+
+    # Open the bus of the display
+    def _open(options)
+      raise NotImplementedError, "open a display by SSD1306SPI, SSD1306I2C or SSD1306Mock"
+    end
+
+    # Display the frame buffer, only the pages changed since the last
+    # display. force: true sends all the pages.
+    def display(options = {})
+      _display(options[:force] ? true : false)
+    end
+
+    # SPI clocks of the ESP32, 80 MHz APB clock divided by 8 to 2,
+    # also used by the mock
+    CALIBRATION_FREQS = [10000000, 13333333, 16000000, 20000000, 26666666, 40000000]
+
+    # Step the bus clock up, showing a test pattern at each clock, and keep
+    # the fastest clock passed. The block checks the pattern on the panel,
+    # e.g. by a button, and returns true if good. Without a block, a frame
+    # sent without TransferError passes, only on a bus detecting the errors.
+    # The frame buffer is cleared.
+    def calibrate_clock(freqs = self.class::CALIBRATION_FREQS)
+      unless block_given? || detects_transfer_errors?
+        raise ArgumentError, "the bus cannot detect a bad clock, give a block to check the panel"
+      end
+      good = freq
+      freqs.each do |f|
+        next if f <= good
+        begin
+          self.freq = f
+          test_pattern("#{f / 1000} kHz")
+          ok = block_given? ? yield(f) : true
+        rescue OLED::TransferError
+          ok = false
+        end
+        break unless ok
+        good = f
+      end
+      self.freq = good
+      clear
+      display(force: true)
+      good
+    end
+
+    # SPI has no acknowledge, a frame is sent at any clock
+    def detects_transfer_errors?
+      false
+    end
+
+    # Every other row lit, the data line toggles on each bit
+    def test_pattern(label)
+      color = @color
+      clear
+      @color = OLED::WHITE
+      y = 0
+      while y < height
+        hline(0, y, width)
+        y += 2
+      end
+      @color = OLED::BLACK
+      fill_rect(0, 0, label.size * 8 + 4, 12)
+      @color = OLED::WHITE
+      text(2, 2, label)
+      @color = color
+      # every page is sent at the new clock
+      display(force: true)
+    end
+
+    # Run the block at the frame rate cap, and display the frame if changed.
+    # The block gets the frame count. Runs forever if frames is nil.
+    def run_at(fps, frames = nil)
+      self.frame_rate = fps
+      n = 0
+      while frames.nil? || n < frames
+        begin_frame
+        yield n
+        # the last frame is not dropped
+        end_frame(!frames.nil? && n + 1 >= frames)
+        n += 1
+      end
+      self
+    end
+  end
+
+  # SPI wired display, the SPI bus is shared by the displays.
+  class SSD1306SPI < SSD1306
+    def _open(options)
       @cs = options[:cs] || CS
       @dc = options[:dc] || DC
       @rst = options[:rst] || RST
@@ -16,8 +122,46 @@ module OLED
       @freq = options[:freq] || SPI_FREQ
       @spi_mode = options[:spi_mode] || SPI_MODE
       @dma_ch = options[:dma_ch] || DMA
-      
-      _init(@cs, @dc, @rst, @mosi, @sck, @miso, @freq, @spi_mode, @dma_ch)
+
+      _init(@cs, @dc, @rst, @mosi, @sck, @miso, @freq, @spi_mode, @dma_ch,
+            @width, @height, @controller, @col_offset)
+    end
+  end
+
+  # I2C wired display, the I2C driver is shared by the displays on the port.
+  class SSD1306I2C < SSD1306
+    # Standard, fast, and fast mode plus clocks
+    CALIBRATION_FREQS = [100000, 400000, 800000, 1000000]
+
+    # The display does not acknowledge a byte broken by a bad clock
+    def detects_transfer_errors?
+      true
+    end
+
+    def _open(options)
+      @port = options[:port] || I2C_PORT
+      @sda = options[:sda] || SDA
+      @scl = options[:scl] || SCL
+      @rst = options[:rst] || -1
+      @addr = options[:addr] || I2C_ADDR
+      @freq = options[:freq] || I2C_FREQ
+
+      _init_i2c(@port, @sda, @scl, @rst, @addr, @freq,
+                @width, @height, @controller, @col_offset)
+    end
+  end
+
+  # Display without the hardware, records the traffic and the simulated
+  # transfer time of the SPI or I2C bus.
+  class SSD1306Mock < SSD1306
+    def _open(options)
+      @bus = options[:bus] || :spi
+      @freq = options[:freq] || (@bus == :i2c ? I2C_FREQ : SPI_FREQ)
+      @overhead_ns = options[:overhead_ns] || MOCK_OVERHEAD_NS
+      @log_size = options[:log_size] || MOCK_LOG_SIZE
+
+      _init_mock(@freq, @bus == :i2c ? BUS_I2C : BUS_SPI, @overhead_ns, @log_size,
+                 @width, @height, @controller, @col_offset)
     end
   end
 end
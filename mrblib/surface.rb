@@ -0,0 +1,30 @@
+module OLED
+  class Surface
+    attr_accessor :color
+    attr_accessor :fontsize
+
+    # A frame buffer of width x height shown on the attached displays,
+    # the height in a multiple of 8.
+    def initialize(width, height, options = {})
+      @color = options[:color] || OLED::WHITE
+      @fontsize = options[:fontsize] || 1
+      @panels = []
+      _init(width, height)
+    end
+
+    # Show the region at (x, y) of the surface on the display, in the size
+    # of the display. y is a multiple of 8.
+    def attach(display, x, y)
+      _attach(display, x, y)
+      # keep the displays alive while the surface is used
+      @panels << display
+      self
+    end
+
+    # Display the surface on the panels, only the pages changed on each
+    # panel. force: true sends all the pages.
+    def display(options = {})
+      _display(options[:force] ? true : false)
+    end
+  end
+end
@@ -0,0 +1,44 @@
+module OLED
+  class UI
+    # Container widget with a border
+    def panel(x, y, w, h, parent = nil)
+      _add(PANEL, parent || NO_PARENT, x, y, w, h)
+    end
+
+    def label(x, y, w, h, text, parent = nil)
+      id = _add(LABEL, parent || NO_PARENT, x, y, w, h)
+      set(id, text)
+      id
+    end
+
+    # Right aligned Integer
+    def number(x, y, w, h, value = 0, parent = nil)
+      id = _add(NUMBER, parent || NO_PARENT, x, y, w, h)
+      set(id, value)
+      id
+    end
+
+    def bar(x, y, w, h, min = 0, max = 100, parent = nil)
+      id = _add(BAR, parent || NO_PARENT, x, y, w, h)
+      range(id, min, max)
+      id
+    end
+
+    # Half circle gauge with a needle
+    def gauge(x, y, w, h, min = 0, max = 100, parent = nil)
+      id = _add(GAUGE, parent || NO_PARENT, x, y, w, h)
+      range(id, min, max)
+      id
+    end
+
+    def icon(x, y, w, h, data, parent = nil)
+      id = _add(ICON, parent || NO_PARENT, x, y, w, h)
+      bitmap(id, data)
+      id
+    end
+
+    def []=(id, value)
+      set(id, value)
+    end
+  end
+end
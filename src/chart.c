@@ -0,0 +1,288 @@
+// ===================================================================
+//
+//    Strip chart for SSD1306
+//
+// ===================================================================
+//
+// The samples are kept in a ring buffer per series, a sample per
+// column of the plot area. A new sample is drawn as a vertical span
+// from the previous sample, so only its own column is drawn.
+//
+//   scroll : the plot area is shifted left by a column in the frame
+//            buffer, and the new column is drawn on the right edge.
+//            Every column is changed, the whole plot area is sent.
+//   sweep  : the new column is drawn at the cursor, and the column
+//            ahead is cleared as the gap. Two columns are sent.
+//
+// The auto-scaling grows the range when a sample is out of it, and
+// shrinks it when the samples use less than a half of it. The plot
+// area is drawn again from the ring buffer after rescaling.
+//
+// ===================================================================
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chart.h"
+
+bool
+chart_init(chart_t *chart, tinygrafx_rect_t area, uint8_t series, uint8_t mode)
+{
+  memset(chart, 0, sizeof(chart_t));
+  chart->area = area;
+  chart->mode = mode;
+  chart->series = series;
+  chart->autoscale = true;
+  chart->max = 1;
+  chart->samples = (int32_t *)malloc(series * area.w * sizeof(int32_t));
+  return chart->samples != NULL;
+}
+
+void
+chart_free(chart_t *chart)
+{
+  free(chart->samples);
+  chart->samples = NULL;
+}
+
+// The plot area is in the drawing area, it may be rotated after init
+bool
+chart_fits(const chart_t *chart, tinygrafx_t tg)
+{
+  tinygrafx_rect_t r = chart->area;
+  return rect_clip(tg, &r) && (r.w == chart->area.w) && (r.h == chart->area.h);
+}
+
+static void
+chart_add_damage(chart_t *chart, const tinygrafx_rect_t *r)
+{
+  if (chart->has_damage) {
+    rect_union(&chart->damage, r);
+  } else {
+    chart->damage = *r;
+    chart->has_damage = true;
+  }
+}
+
+// Sample of the series, age 0 is the newest
+static int32_t
+chart_sample(const chart_t *chart, uint8_t s, uint16_t age)
+{
+  uint16_t w = chart->area.w;
+  return chart->samples[s * w + (chart->head + w - 1 - age) % w];
+}
+
+// Row of the value in the plot area, the range is clamped
+static int16_t
+chart_row(const chart_t *chart, int32_t value)
+{
+  int16_t h = chart->area.h;
+
+  if (value <= chart->min) {
+    return chart->area.y + h - 1;
+  }
+  if (value >= chart->max) {
+    return chart->area.y;
+  }
+  int64_t scaled = ((int64_t)value - chart->min) * (h - 1) / ((int64_t)chart->max - chart->min);
+  return chart->area.y + h - 1 - (int16_t)scaled;
+}
+
+// Draw the sample of the age at the column, joined to the previous sample
+static void
+chart_draw_column(chart_t *chart, tinygrafx_t tg, int16_t column, uint16_t age, bool join)
+{
+  int16_t x = chart->area.x + column;
+
+  for (uint8_t s = 0; s < chart->series; s++) {
+    int16_t y0 = chart_row(chart, chart_sample(chart, s, age));
+    int16_t y1 = y0;
+    if (join && (age + 1 < chart->count)) {
+      y1 = chart_row(chart, chart_sample(chart, s, age + 1));
+    }
+    if (y0 > y1) {
+      swap_int16_t(y0, y1);
+    }
+    draw_vertical_line(tg, x, y0, y1 - y0 + 1, WHITE);
+  }
+}
+
+static void
+chart_clear_column(chart_t *chart, tinygrafx_t tg, int16_t column)
+{
+  draw_vertical_line(tg, chart->area.x + column, chart->area.y, chart->area.h, BLACK);
+}
+
+// Bits of the plot area on the page
+static uint8_t
+chart_page_mask(const chart_t *chart, int16_t page)
+{
+  int16_t top = (chart->area.y > page * 8) ? chart->area.y : page * 8;
+  int16_t bottom = (chart->area.y + chart->area.h < page * 8 + 8) ? (chart->area.y + chart->area.h) : (page * 8 + 8);
+  return ((1 << (bottom - top)) - 1) << (top - page * 8);
+}
+
+// Shift the plot area left by a column in the frame buffer
+static void
+chart_shift_left(chart_t *chart, tinygrafx_t tg)
+{
+  int16_t page0 = chart->area.y / 8;
+  int16_t page1 = (chart->area.y + chart->area.h - 1) / 8;
+
+  for (int16_t page = page0; page <= page1; page++) {
+    uint8_t mask = chart_page_mask(chart, page);
+    uint8_t *row = tg.display_buffer + page * tg.display_width + chart->area.x;
+    if (mask == 0xFF) {
+      memmove(row, row + 1, chart->area.w - 1);
+    } else {
+      for (int16_t i = 0; i < chart->area.w - 1; i++) {
+        row[i] = (row[i] & ~mask) | (row[i + 1] & mask);
+      }
+    }
+  }
+}
+
+// Draw the plot area from the ring buffer
+static void
+chart_draw_all(chart_t *chart, tinygrafx_t tg)
+{
+  uint16_t w = chart->area.w;
+
+  draw_fill_rect(tg, chart->area.x, chart->area.y, w, chart->area.h, BLACK);
+  if (chart->mode == CHART_SCROLL) {
+    for (uint16_t age = 0; age < chart->count; age++) {
+      chart_draw_column(chart, tg, w - 1 - age, age, true);
+    }
+  } else {
+    // the oldest sample is the gap when the ring is full
+    uint16_t shown = (chart->count < w) ? chart->count : (w - 1);
+    for (uint16_t age = 0; age < shown; age++) {
+      int16_t column = (chart->total - 1 - age) % w;
+      chart_draw_column(chart, tg, column, age, column > 0);
+    }
+  }
+  chart->redraw = false;
+  chart_add_damage(chart, &chart->area);
+}
+
+// Draw the plot area again, the frame buffer was lost
+void
+chart_redraw(chart_t *chart, tinygrafx_t tg)
+{
+  chart_draw_all(chart, tg);
+}
+
+// Fit the range to the samples. Returns true if the range was changed.
+static bool
+chart_rescale(chart_t *chart)
+{
+  int32_t lo = chart_sample(chart, 0, 0);
+  int32_t hi = lo;
+
+  for (uint8_t s = 0; s < chart->series; s++) {
+    for (uint16_t age = 0; age < chart->count; age++) {
+      int32_t v = chart_sample(chart, s, age);
+      lo = (v < lo) ? v : lo;
+      hi = (v > hi) ? v : hi;
+    }
+  }
+  int64_t range = (int64_t)chart->max - chart->min;
+  int64_t span = (int64_t)hi - lo;
+  // a flat signal fits any range around it
+  if ((lo >= chart->min) && (hi <= chart->max) && ((span < 2) || (span * 2 >= range))) {
+    return false;
+  }
+
+  // 1/8 of the span as the margin
+  int64_t margin = span / 8;
+  int64_t min = (int64_t)lo - ((margin > 0) ? margin : 1);
+  int64_t max = (int64_t)hi + ((margin > 0) ? margin : 1);
+  min = (min < INT32_MIN) ? INT32_MIN : min;
+  max = (max > INT32_MAX) ? INT32_MAX : max;
+  if ((min == chart->min) && (max == chart->max)) {
+    return false;
+  }
+  chart->min = min;
+  chart->max = max;
+  return true;
+}
+
+// Clear the samples and the plot area
+void
+chart_clear(chart_t *chart, tinygrafx_t tg)
+{
+  chart->head = 0;
+  chart->count = 0;
+  chart->total = 0;
+  chart_draw_all(chart, tg);
+}
+
+// Fixed range, drawn again by the next push
+void
+chart_set_range(chart_t *chart, int32_t min, int32_t max)
+{
+  chart->autoscale = false;
+  chart->min = min;
+  chart->max = max;
+  chart->redraw = true;
+}
+
+void
+chart_set_autoscale(chart_t *chart)
+{
+  chart->autoscale = true;
+  chart->redraw = true;
+}
+
+// Append a sample of each series, and draw it in the frame buffer
+void
+chart_push(chart_t *chart, tinygrafx_t tg, const int32_t *values)
+{
+  uint16_t w = chart->area.w;
+
+  for (uint8_t s = 0; s < chart->series; s++) {
+    chart->samples[s * w + chart->head] = values[s];
+  }
+  chart->head = (chart->head + 1) % w;
+  if (chart->count < w) {
+    chart->count++;
+  }
+  chart->total++;
+
+  if (chart->autoscale && chart_rescale(chart)) {
+    chart->redraw = true;
+  }
+  if (chart->redraw) {
+    chart_draw_all(chart, tg);
+    return;
+  }
+
+  if (chart->mode == CHART_SCROLL) {
+    chart_shift_left(chart, tg);
+    chart_clear_column(chart, tg, w - 1);
+    chart_draw_column(chart, tg, w - 1, 0, true);
+    chart_add_damage(chart, &chart->area);
+  } else {
+    int16_t column = (chart->total - 1) % w;
+    tinygrafx_rect_t r = { chart->area.x + column, chart->area.y, 1, chart->area.h };
+    chart_clear_column(chart, tg, column);
+    chart_draw_column(chart, tg, column, 0, column > 0);
+    if (column + 1 < w) {
+      chart_clear_column(chart, tg, column + 1);
+      r.w = 2;
+    }
+    chart_add_damage(chart, &r);
+  }
+}
+
+// Take the area changed since the last call, false if none
+bool
+chart_take_damage(chart_t *chart, tinygrafx_rect_t *damage)
+{
+  if (!chart->has_damage) {
+    return false;
+  }
+  *damage = chart->damage;
+  chart->has_damage = false;
+  return true;
+}
@@ -0,0 +1,40 @@
+#ifndef CHARTH_
+#define CHARTH_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tiny_grafx.h"
+
+// Chart modes
+#define CHART_SCROLL    0   // the plot moves left, the new sample on the right edge
+#define CHART_SWEEP     1   // the cursor moves right, overwriting the oldest sample (default)
+
+#define CHART_MAX_SERIES  4
+
+// Strip chart, a ring buffer of area.w samples per series
+typedef struct chart_t {
+  tinygrafx_rect_t area;    // plot area in the drawing area
+  uint8_t mode;             // CHART_SCROLL or CHART_SWEEP
+  uint8_t series;           // number of series
+  int32_t *samples;         // ring buffers, series * area.w
+  uint16_t head;            // ring index of the next sample
+  uint16_t count;           // samples in the ring
+  uint32_t total;           // samples pushed
+  bool autoscale;           // the range follows the samples
+  int32_t min, max;         // value range of the plot area
+  bool redraw;              // the plot area is drawn again by the next push
+  bool has_damage;          // damage is valid
+  tinygrafx_rect_t damage;  // area changed in the frame buffer
+} chart_t;
+
+bool chart_init(chart_t *chart, tinygrafx_rect_t area, uint8_t series, uint8_t mode);
+void chart_free(chart_t *chart);
+bool chart_fits(const chart_t *chart, tinygrafx_t tg);
+void chart_clear(chart_t *chart, tinygrafx_t tg);
+void chart_redraw(chart_t *chart, tinygrafx_t tg);
+void chart_set_range(chart_t *chart, int32_t min, int32_t max);
+void chart_set_autoscale(chart_t *chart);
+void chart_push(chart_t *chart, tinygrafx_t tg, const int32_t *values);
+bool chart_take_damage(chart_t *chart, tinygrafx_rect_t *damage);
+
+#endif /* CHARTH_ */
@@ -0,0 +1,180 @@
+// ===================================================================
+//
+//    Text console for SSD1306
+//
+// ===================================================================
+//
+// The console keeps a character grid with a dirty bit per cell. Only
+// the dirty cells are rendered, each glyph is written as 8 bytes on a
+// page. Scrolling shifts the frame buffer by a page instead of
+// rendering all cells again.
+//
+// ===================================================================
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "console.h"
+
+bool
+console_init(console_t *con, tinygrafx_t tg)
+{
+  memset(con, 0, sizeof(console_t));
+  con->cols = tg.display_width / tg.font_width;
+  con->rows = tg.display_pages;
+  con->cells = (uint8_t *)malloc(con->cols * con->rows);
+  con->dirty = (uint32_t *)calloc(con->rows, sizeof(uint32_t));
+  if ((con->cells == NULL) || (con->dirty == NULL)) {
+    console_free(con);
+    return false;
+  }
+  memset(con->cells, ' ', con->cols * con->rows);
+  return true;
+}
+
+// The grid is of the drawing area, it may be rotated or reopened after init
+bool
+console_fits(const console_t *con, tinygrafx_t tg)
+{
+  return (con->cols == tg.display_width / tg.font_width) && (con->rows == tg.display_pages);
+}
+
+void
+console_free(console_t *con)
+{
+  free(con->cells);
+  free(con->dirty);
+  con->cells = NULL;
+  con->dirty = NULL;
+}
+
+static void
+console_damage(console_t *con, tinygrafx_rect_t r)
+{
+  if (con->has_damage) {
+    rect_union(&con->damage, &r);
+  } else {
+    con->damage = r;
+    con->has_damage = true;
+  }
+}
+
+// Rows of the frame buffer, clamped to the drawing area
+static uint8_t
+console_buffer_rows(const console_t *con, tinygrafx_t tg)
+{
+  return (con->rows < tg.display_pages) ? con->rows : tg.display_pages;
+}
+
+// Clear the console area and move the cursor home
+void
+console_clear(console_t *con, tinygrafx_t tg)
+{
+  memset(con->cells, ' ', con->cols * con->rows);
+  memset(con->dirty, 0, con->rows * sizeof(uint32_t));
+  memset(tg.display_buffer, 0, console_buffer_rows(con, tg) * tg.display_width);
+  con->cx = 0;
+  con->cy = 0;
+  tinygrafx_rect_t all = { 0, 0, con->cols * tg.font_width, con->rows * 8 };
+  console_damage(con, all);
+}
+
+// Render all cells again, the frame buffer was lost
+void
+console_invalidate(console_t *con)
+{
+  uint32_t bits = (con->cols >= 32) ? 0xFFFFFFFFu : ((1u << con->cols) - 1);
+
+  for (uint8_t row = 0; row < con->rows; row++) {
+    con->dirty[row] = bits;
+  }
+}
+
+// Scroll up a row by shifting the pages of the frame buffer
+static void
+console_scroll(console_t *con, tinygrafx_t tg)
+{
+  uint32_t row_bytes = tg.display_width;
+  uint8_t rows = console_buffer_rows(con, tg);
+
+  memmove(tg.display_buffer, tg.display_buffer + row_bytes, (rows - 1) * row_bytes);
+  memset(tg.display_buffer + (rows - 1) * row_bytes, 0, row_bytes);
+  memmove(con->cells, con->cells + con->cols, (con->rows - 1) * con->cols);
+  memset(con->cells + (con->rows - 1) * con->cols, ' ', con->cols);
+  memmove(con->dirty, con->dirty + 1, (con->rows - 1) * sizeof(uint32_t));
+  con->dirty[con->rows - 1] = 0;
+
+  tinygrafx_rect_t all = { 0, 0, con->cols * tg.font_width, con->rows * 8 };
+  console_damage(con, all);
+}
+
+static void
+console_newline(console_t *con, tinygrafx_t tg)
+{
+  con->cx = 0;
+  if (con->cy + 1 < con->rows) {
+    con->cy++;
+  } else {
+    console_scroll(con, tg);
+  }
+}
+
+// Write the text at the cursor, the cells are rendered by console_render
+void
+console_write(console_t *con, tinygrafx_t tg, const uint8_t *text, int32_t length)
+{
+  for (int32_t i = 0; i < length; i++) {
+    uint8_t c = text[i];
+    if (c == '\n') {
+      console_newline(con, tg);
+      continue;
+    }
+    if (c == '\r') {
+      con->cx = 0;
+      continue;
+    }
+    if (con->cx >= con->cols) {
+      // wrap
+      console_newline(con, tg);
+    }
+
+    uint8_t *cell = &con->cells[con->cy * con->cols + con->cx];
+    if (*cell != c) {
+      *cell = c;
+      con->dirty[con->cy] |= (1u << con->cx);
+    }
+    con->cx++;
+  }
+}
+
+// Render the dirty cells, returns the area changed since the last render
+bool
+console_render(console_t *con, tinygrafx_t tg, tinygrafx_rect_t *damage)
+{
+  for (uint8_t row = 0; row < con->rows; row++) {
+    uint32_t bits = con->dirty[row];
+    if (bits == 0) {
+      continue;
+    }
+    int16_t first = -1, last = 0;
+    for (uint8_t col = 0; col < con->cols; col++) {
+      if (bits & (1u << col)) {
+        draw_char_page(tg, col * tg.font_width, row, con->cells[row * con->cols + col]);
+        if (first < 0) {
+          first = col;
+        }
+        last = col;
+      }
+    }
+    con->dirty[row] = 0;
+    tinygrafx_rect_t r = { first * tg.font_width, row * 8, (last - first + 1) * tg.font_width, 8 };
+    console_damage(con, r);
+  }
+
+  if (!con->has_damage) {
+    return false;
+  }
+  *damage = con->damage;
+  con->has_damage = false;
+  return true;
+}
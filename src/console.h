@@ -0,0 +1,28 @@
+#ifndef CONSOLEH_
+#define CONSOLEH_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tiny_grafx.h"
+
+// Text console, a character cell is 8x8 pixel on a page
+typedef struct console_t {
+  uint8_t cols;             // columns
+  uint8_t rows;             // rows (pages)
+  uint8_t cx;               // cursor column
+  uint8_t cy;               // cursor row
+  uint8_t *cells;           // characters, cols * rows
+  uint32_t *dirty;          // dirty bit per cell, a word per row
+  bool has_damage;          // damage is valid
+  tinygrafx_rect_t damage;  // area changed in the frame buffer
+} console_t;
+
+bool console_init(console_t *con, tinygrafx_t tg);
+bool console_fits(const console_t *con, tinygrafx_t tg);
+void console_free(console_t *con);
+void console_clear(console_t *con, tinygrafx_t tg);
+void console_invalidate(console_t *con);
+void console_write(console_t *con, tinygrafx_t tg, const uint8_t *text, int32_t length);
+bool console_render(console_t *con, tinygrafx_t tg, tinygrafx_rect_t *damage);
+
+#endif /* CONSOLEH_ */
@@ -0,0 +1,158 @@
+// ===================================================================
+//
+//    Dithering for SSD1306
+//
+// ===================================================================
+//
+// 8-bit grayscale images are rendered into the 1bpp frame buffer by an
+// ordered dither (8x8 Bayer threshold table) or an error diffusion
+// dither (Floyd-Steinberg or Atkinson kernel table). No ESP-IDF
+// dependency, so it can be benchmarked on a host.
+//
+// ===================================================================
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "dither.h"
+
+// 8x8 Bayer matrix scaled to the 0-255 thresholds
+static const uint8_t bayer8x8[8][8] = {
+  {   0, 128,  32, 160,   8, 136,  40, 168 },
+  { 192,  64, 224,  96, 200,  72, 232, 104 },
+  {  48, 176,  16, 144,  56, 184,  24, 152 },
+  { 240, 112, 208,  80, 248, 120, 216,  88 },
+  {  12, 140,  44, 172,   4, 132,  36, 164 },
+  { 204,  76, 236, 108, 196,  68, 228, 100 },
+  {  60, 188,  28, 156,  52, 180,  20, 148 },
+  { 252, 124, 220,  92, 244, 116, 212,  84 }
+};
+
+// Error diffusion kernel, error * weight >> shift goes to (x + dx, y + dy)
+typedef struct diffusion_tap_t {
+  int8_t dx;
+  int8_t dy;
+  uint8_t weight;
+} diffusion_tap_t;
+
+typedef struct diffusion_kernel_t {
+  uint8_t taps;
+  uint8_t shift;
+  diffusion_tap_t tap[6];
+} diffusion_kernel_t;
+
+static const diffusion_kernel_t floyd_steinberg = {
+  4, 4, { {1, 0, 7}, {-1, 1, 3}, {0, 1, 5}, {1, 1, 1} }
+};
+
+// Atkinson diffuses 6/8 of the error, lighter on the shadows
+static const diffusion_kernel_t atkinson = {
+  6, 3, { {1, 0, 1}, {2, 0, 1}, {-1, 1, 1}, {0, 1, 1}, {1, 1, 1}, {0, 2, 1} }
+};
+
+// rows of the error buffer, and the margin for dx = -1 .. +2
+#define ERR_ROWS    3
+#define ERR_MARGIN  2
+
+static inline void
+put_pixel(tinygrafx_t tg, int16_t x, int16_t y, bool white)
+{
+  if ((x >= 0) && (x < TG_DISPLAY_WIDTH(tg)) && (y >= 0) && (y < TG_DISPLAY_HEIGHT(tg))) {
+    uint8_t *p = &tg.display_buffer[x + (y / 8) * TG_DISPLAY_WIDTH(tg)];
+    if (white) {
+      *p |= (1 << (y & 7));
+    } else {
+      *p &= ~(1 << (y & 7));
+    }
+  }
+}
+
+static void
+dither_ordered(tinygrafx_t tg, int16_t x, int16_t y, const uint8_t *gray, int16_t w, int16_t h, bool bayer)
+{
+  for (int16_t y1 = 0; y1 < h; y1++) {
+    const uint8_t *row = gray + y1 * w;
+    const uint8_t *threshold = bayer8x8[(y + y1) & 7];
+    for (int16_t x1 = 0; x1 < w; x1++) {
+      uint8_t t = bayer ? threshold[(x + x1) & 7] : 127;
+      put_pixel(tg, x + x1, y + y1, row[x1] > t);
+    }
+  }
+}
+
+static bool
+dither_diffusion(tinygrafx_t tg, int16_t x, int16_t y, const uint8_t *gray, int16_t w, int16_t h,
+                 const diffusion_kernel_t *kernel)
+{
+  int16_t stride = w + 2 * ERR_MARGIN;
+  int16_t *err = (int16_t *)calloc(ERR_ROWS * stride, sizeof(int16_t));
+  if (err == NULL) {
+    return false;
+  }
+
+  for (int16_t y1 = 0; y1 < h; y1++) {
+    int16_t *cur = err + (y1 % ERR_ROWS) * stride + ERR_MARGIN;
+    const uint8_t *row = gray + y1 * w;
+    for (int16_t x1 = 0; x1 < w; x1++) {
+      int16_t v = row[x1] + cur[x1];
+      bool white = (v > 127);
+      int16_t e = white ? (v - 255) : v;
+      put_pixel(tg, x + x1, y + y1, white);
+
+      for (uint8_t i = 0; i < kernel->taps; i++) {
+        const diffusion_tap_t *t = &kernel->tap[i];
+        int16_t *dst = err + ((y1 + t->dy) % ERR_ROWS) * stride + ERR_MARGIN;
+        dst[x1 + t->dx] += (e * t->weight) >> kernel->shift;
+      }
+    }
+    // this row is reused for the row (y1 + ERR_ROWS)
+    memset(cur - ERR_MARGIN, 0, stride * sizeof(int16_t));
+  }
+
+  free(err);
+  return true;
+}
+
+bool
+dither_image(tinygrafx_t tg, int16_t x, int16_t y, const uint8_t *gray, int16_t w, int16_t h, int16_t method)
+{
+  switch (method) {
+    case DITHER_THRESHOLD:
+      dither_ordered(tg, x, y, gray, w, h, false);
+      return true;
+    case DITHER_FLOYD_STEINBERG:
+      return dither_diffusion(tg, x, y, gray, w, h, &floyd_steinberg);
+    case DITHER_ATKINSON:
+      return dither_diffusion(tg, x, y, gray, w, h, &atkinson);
+    case DITHER_BAYER:
+    default:
+      dither_ordered(tg, x, y, gray, w, h, true);
+      return true;
+  }
+}
+
+// Each pixel is quantized to a level (0 .. levels - 1) with the Bayer
+// dither between the levels, and lit on the first "level" planes.
+void
+dither_gray_planes(tinygrafx_t tg, const uint8_t *gray, int16_t levels, uint8_t *planes)
+{
+  int16_t steps = levels - 1;
+
+  memset(planes, 0, steps * TG_DISPLAY_PIXEL(tg));
+  for (int16_t y = 0; y < TG_DISPLAY_HEIGHT(tg); y++) {
+    const uint8_t *row = gray + y * TG_DISPLAY_WIDTH(tg);
+    const uint8_t *threshold = bayer8x8[y & 7];
+    uint8_t mask = 1 << (y & 7);
+    uint32_t offset = (y / 8) * TG_DISPLAY_WIDTH(tg);
+    for (int16_t x = 0; x < TG_DISPLAY_WIDTH(tg); x++) {
+      // scale to 0 .. steps * 256, the fraction is dithered
+      uint16_t s = row[x] * steps;
+      s += s >> 8;
+      int16_t level = (s >> 8) + ((s & 0xFF) > threshold[x & 7]);
+      for (int16_t i = 0; i < level; i++) {
+        planes[i * TG_DISPLAY_PIXEL(tg) + offset + x] |= mask;
+      }
+    }
+  }
+}
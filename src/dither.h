@@ -0,0 +1,26 @@
+#ifndef DITHERH_
+#define DITHERH_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tiny_grafx.h"
+
+// Dithering methods
+#define DITHER_THRESHOLD        0
+#define DITHER_BAYER            1
+#define DITHER_FLOYD_STEINBERG  2
+#define DITHER_ATKINSON         3
+
+// Temporal grayscale levels
+#define GRAY_MIN_LEVELS 2
+#define GRAY_MAX_LEVELS 4
+
+// Render an 8-bit grayscale image (w x h, row major) at (x, y).
+// Returns false if the work area could not be allocated.
+bool dither_image(tinygrafx_t tg, int16_t x, int16_t y, const uint8_t *gray, int16_t w, int16_t h, int16_t method);
+
+// Split a full screen grayscale image into (levels - 1) bit-planes.
+// planes must have (levels - 1) * display_pixel bytes.
+void dither_gray_planes(tinygrafx_t tg, const uint8_t *gray, int16_t levels, uint8_t *planes);
+
+#endif /* DITHERH_ */
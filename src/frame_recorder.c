@@ -0,0 +1,199 @@
+// ===================================================================
+//
+//    Frame recorder for SSD1306
+//
+// ===================================================================
+//
+// Each frame is recorded as the XOR-delta against the previous frame,
+// packed by the run-length encoding below. Every record starts with a
+// FRAME_RECORD_HEADER_SIZE byte header.
+//
+//   0x00-0x7F : (n + 1) unchanged bytes
+//   0x80-0xFF : (n & 0x7F) + 1 changed bytes, XOR values follow
+//
+// A keyframe is encoded against a blank frame, so the replay can start
+// from any keyframe after the older records were overwritten.
+//
+// ===================================================================
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_recorder.h"
+
+#define RUN_MAX 128
+
+uint32_t
+frame_delta_encode(const uint8_t *prev, const uint8_t *frame, uint32_t size, uint8_t *out)
+{
+  uint32_t i = 0, n = 0, start, run;
+
+  while (i < size) {
+    // unchanged bytes
+    run = 0;
+    while ((i + run < size) && (run < RUN_MAX) && (prev[i + run] == frame[i + run])) {
+      run++;
+    }
+    if (run > 0) {
+      out[n++] = run - 1;
+      i += run;
+      continue;
+    }
+
+    // changed bytes, a single unchanged byte is cheaper as a literal
+    start = i;
+    while ((i < size) && (i - start < RUN_MAX)) {
+      if ((prev[i] == frame[i]) && ((i + 1 >= size) || (prev[i + 1] == frame[i + 1]))) {
+        break;
+      }
+      i++;
+    }
+    out[n++] = 0x80 | (i - start - 1);
+    for (uint32_t j = start; j < i; j++) {
+      out[n++] = prev[j] ^ frame[j];
+    }
+  }
+  return n;
+}
+
+bool
+frame_delta_decode(const uint8_t *in, uint32_t length, uint8_t *frame, uint32_t size)
+{
+  uint32_t i = 0, pos = 0, run;
+
+  while (i < length) {
+    run = (in[i] & 0x7F) + 1;
+    if (pos + run > size) {
+      return false;
+    }
+    if (in[i++] & 0x80) {
+      if (i + run > length) {
+        return false;
+      }
+      for (uint32_t j = 0; j < run; j++) {
+        frame[pos++] ^= in[i++];
+      }
+    } else {
+      pos += run;
+    }
+  }
+  return (pos == size);
+}
+
+bool
+frame_recorder_init(frame_recorder_t *rec, uint32_t frame_size, uint32_t ring_size, uint16_t keyframe_interval)
+{
+  memset(rec, 0, sizeof(frame_recorder_t));
+  rec->ring = (uint8_t *)malloc(ring_size);
+  rec->prev_frame = (uint8_t *)calloc(1, frame_size);
+  rec->scratch = (uint8_t *)malloc(FRAME_RECORD_HEADER_SIZE + FRAME_DELTA_MAX_SIZE(frame_size));
+  if ((rec->ring == NULL) || (rec->prev_frame == NULL) || (rec->scratch == NULL)) {
+    frame_recorder_deinit(rec);
+    return false;
+  }
+  rec->ring_size = ring_size;
+  rec->frame_size = frame_size;
+  rec->keyframe_interval = (keyframe_interval > 0) ? keyframe_interval : 1;
+  return true;
+}
+
+void
+frame_recorder_deinit(frame_recorder_t *rec)
+{
+  free(rec->ring);
+  free(rec->prev_frame);
+  free(rec->scratch);
+  memset(rec, 0, sizeof(frame_recorder_t));
+}
+
+// Copy bytes into the ring buffer, wrapping at the end.
+static void
+ring_write(frame_recorder_t *rec, uint32_t offset, const uint8_t *data, uint32_t len)
+{
+  uint32_t first = rec->ring_size - offset;
+
+  if (len <= first) {
+    memcpy(rec->ring + offset, data, len);
+  } else {
+    memcpy(rec->ring + offset, data, first);
+    memcpy(rec->ring, data + first, len - first);
+  }
+}
+
+static uint8_t
+ring_byte(const frame_recorder_t *rec, uint32_t offset)
+{
+  return rec->ring[offset % rec->ring_size];
+}
+
+// Overwrite the oldest record.
+static void
+ring_drop_oldest(frame_recorder_t *rec)
+{
+  uint32_t len = ring_byte(rec, rec->head + 2) | (ring_byte(rec, rec->head + 3) << 8);
+
+  len += FRAME_RECORD_HEADER_SIZE;
+  rec->head = (rec->head + len) % rec->ring_size;
+  rec->used -= len;
+  rec->records--;
+  rec->dropped++;
+}
+
+void
+frame_recorder_add(frame_recorder_t *rec, const uint8_t *frame, uint32_t timestamp)
+{
+  uint8_t *record = rec->scratch;
+  uint32_t len;
+  bool keyframe = (rec->since_keyframe == 0);
+
+  if (keyframe) {
+    memset(rec->prev_frame, 0, rec->frame_size);
+  }
+  len = frame_delta_encode(rec->prev_frame, frame, rec->frame_size, record + FRAME_RECORD_HEADER_SIZE);
+  memcpy(rec->prev_frame, frame, rec->frame_size);
+  rec->since_keyframe = (rec->since_keyframe + 1) % rec->keyframe_interval;
+
+  record[0] = keyframe ? FRAME_RECORD_KEYFRAME : 0;
+  record[1] = 0;
+  record[2] = len & 0xFF;
+  record[3] = (len >> 8) & 0xFF;
+  record[4] = timestamp & 0xFF;
+  record[5] = (timestamp >> 8) & 0xFF;
+  record[6] = (timestamp >> 16) & 0xFF;
+  record[7] = (timestamp >> 24) & 0xFF;
+  len += FRAME_RECORD_HEADER_SIZE;
+
+  rec->frames++;
+  rec->raw_bytes += rec->frame_size;
+  rec->encoded_bytes += len;
+  if (len > rec->ring_size) {
+    // never fits, the next frame must be a keyframe
+    rec->dropped++;
+    rec->since_keyframe = 0;
+    return;
+  }
+
+  while (rec->ring_size - rec->used < len) {
+    ring_drop_oldest(rec);
+  }
+  ring_write(rec, (rec->head + rec->used) % rec->ring_size, record, len);
+  rec->used += len;
+  rec->records++;
+}
+
+// Read the records from the oldest one.
+// Returns the number of bytes copied.
+uint32_t
+frame_recorder_read(const frame_recorder_t *rec, uint8_t *data, uint32_t size)
+{
+  uint32_t len = (size < rec->used) ? size : rec->used;
+  uint32_t first = rec->ring_size - rec->head;
+
+  if (len <= first) {
+    memcpy(data, rec->ring + rec->head, len);
+  } else {
+    memcpy(data, rec->ring + rec->head, first);
+    memcpy(data + first, rec->ring, len - first);
+  }
+  return len;
+}
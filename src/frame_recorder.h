@@ -0,0 +1,47 @@
+#ifndef FRAME_RECORDERH_
+#define FRAME_RECORDERH_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Record header flags
+#define FRAME_RECORD_KEYFRAME   0x01
+
+// Record header size [byte]
+//   uint8_t  flags
+//   uint8_t  reserved
+//   uint16_t payload length (little endian)
+//   uint32_t timestamp [ms] (little endian)
+#define FRAME_RECORD_HEADER_SIZE 8
+
+// Worst case size of an encoded frame
+#define FRAME_DELTA_MAX_SIZE(size) ((size) + ((size) + 127) / 128)
+
+// Frame recorder, keeps the XOR-delta encoded frames in a ring buffer.
+typedef struct frame_recorder_t {
+  uint8_t *ring;              // ring buffer of the records
+  uint32_t ring_size;         // ring buffer size [byte]
+  uint32_t head;              // offset of the oldest record
+  uint32_t used;              // ring buffer in use [byte]
+  uint32_t records;           // records in the ring buffer
+  uint8_t *prev_frame;        // last recorded frame
+  uint8_t *scratch;           // encode work area
+  uint32_t frame_size;        // frame buffer size [byte]
+  uint16_t keyframe_interval; // a keyframe is recorded every N frames
+  uint16_t since_keyframe;    // frames since the last keyframe
+  uint32_t frames;            // frames recorded
+  uint32_t dropped;           // records overwritten by the newer frames
+  uint32_t raw_bytes;         // frame bytes before encoding
+  uint32_t encoded_bytes;     // record bytes after encoding
+} frame_recorder_t;
+
+bool frame_recorder_init(frame_recorder_t *rec, uint32_t frame_size, uint32_t ring_size, uint16_t keyframe_interval);
+void frame_recorder_deinit(frame_recorder_t *rec);
+void frame_recorder_add(frame_recorder_t *rec, const uint8_t *frame, uint32_t timestamp);
+uint32_t frame_recorder_read(const frame_recorder_t *rec, uint8_t *data, uint32_t size);
+
+// XOR-delta run-length codec
+uint32_t frame_delta_encode(const uint8_t *prev, const uint8_t *frame, uint32_t size, uint8_t *out);
+bool frame_delta_decode(const uint8_t *in, uint32_t length, uint8_t *frame, uint32_t size);
+
+#endif /* FRAME_RECORDERH_ */
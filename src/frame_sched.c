@@ -0,0 +1,99 @@
+// ===================================================================
+//
+//    Frame scheduler for SSD1306
+//
+// ===================================================================
+//
+// begin_frame / end_frame pair measures the drawing and the transfer
+// time, skips the transfer of an unchanged frame, and sleeps the rest
+// of the frame period. The deadline advances by the frame period, so
+// the average frame rate is kept even if the tick period is coarse.
+//
+// ===================================================================
+
+#include <stdlib.h>
+
+#include "oled_platform.h"
+
+#include "frame_sched.h"
+
+// exponential moving average over about 8 frames
+#define EWMA_SHIFT 3
+
+void
+frame_sched_set_rate(frame_sched_t *sched, uint32_t fps)
+{
+  sched->period_us = (fps > 0) ? (1000000 / fps) : 0;
+  sched->deadline = 0;
+}
+
+void
+frame_sched_begin(frame_sched_t *sched)
+{
+  int64_t now = oled_time_us();
+
+  if (sched->frames > 0) {
+    int32_t interval = now - sched->frame_start;
+    int32_t target = (sched->period_us > 0) ? sched->period_us : sched->interval_us;
+    int32_t deviation = abs(interval - target);
+    if (sched->frames == 1) {
+      sched->interval_us = interval;
+      sched->jitter_us = 0;
+    } else {
+      sched->interval_us += (interval - (int32_t)sched->interval_us) >> EWMA_SHIFT;
+      sched->jitter_us += (deviation - (int32_t)sched->jitter_us) >> EWMA_SHIFT;
+    }
+  }
+  sched->frame_start = now;
+
+  // start over after an overrun, instead of a burst of frames to catch up
+  if ((sched->deadline == 0) || (now > sched->deadline)) {
+    sched->deadline = now;
+  }
+  sched->deadline += sched->period_us;
+  sched->frames++;
+}
+
+// Decide whether the drawn frame is sent to the display.
+// changed is false if no page differs from the last frame sent.
+// The last frame is not dropped, no next frame shows it.
+bool
+frame_sched_need_push(frame_sched_t *sched, bool changed, bool last)
+{
+  int64_t now = oled_time_us();
+  sched->draw_us = now - sched->frame_start;
+
+  if (!changed) {
+    sched->skipped++;
+    return false;
+  }
+  // drop a late frame to catch up, but never two in a row
+  if ((sched->period_us > 0) && (now > sched->deadline) && !sched->last_dropped && !last) {
+    sched->dropped++;
+    sched->last_dropped = true;
+    return false;
+  }
+  sched->last_dropped = false;
+  return true;
+}
+
+void
+frame_sched_pushed(frame_sched_t *sched, int64_t transfer_start)
+{
+  sched->transfer_us = oled_time_us() - transfer_start;
+  sched->pushed++;
+}
+
+// Sleep the rest of the frame period.
+void
+frame_sched_wait(frame_sched_t *sched)
+{
+  if (sched->period_us == 0) {
+    return;
+  }
+
+  int64_t remain = sched->deadline - oled_time_us();
+  if (remain > 0) {
+    oled_delay_us(remain);
+  }
+}
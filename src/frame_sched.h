@@ -0,0 +1,29 @@
+#ifndef FRAME_SCHEDH_
+#define FRAME_SCHEDH_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Frame scheduler, paces the frames to the frame rate cap.
+typedef struct frame_sched_t {
+  uint32_t period_us;       // frame period [us], 0 = no frame rate cap
+  int64_t frame_start;      // start time of the current frame [us]
+  int64_t deadline;         // end time of the current frame [us]
+  uint32_t interval_us;     // average frame interval [us]
+  uint32_t jitter_us;       // average deviation of the frame interval [us]
+  uint32_t draw_us;         // drawing time of the last frame [us]
+  uint32_t transfer_us;     // transfer time of the last pushed frame [us]
+  uint32_t frames;          // frames begun
+  uint32_t pushed;          // frames sent to the display
+  uint32_t skipped;         // unchanged frames not sent
+  uint32_t dropped;         // late frames not sent to catch up
+  bool last_dropped;        // the previous frame was dropped
+} frame_sched_t;
+
+void frame_sched_set_rate(frame_sched_t *sched, uint32_t fps);
+void frame_sched_begin(frame_sched_t *sched);
+bool frame_sched_need_push(frame_sched_t *sched, bool changed, bool last);
+void frame_sched_pushed(frame_sched_t *sched, int64_t transfer_start);
+void frame_sched_wait(frame_sched_t *sched);
+
+#endif /* FRAME_SCHEDH_ */
@@ -0,0 +1,185 @@
+#ifndef OLED_PLATFORMH_
+#define OLED_PLATFORMH_
+
+// Platform shim, the time, the delay and the log.
+// The controller logic, the mock transport and the graphics also build
+// on a host without ESP-IDF. The host build maps the FreeRTOS calls of
+// the binding (the bus lock and the grayscale task) onto pthreads.
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+// Monotonic time [us]
+static inline int64_t
+oled_time_us(void)
+{
+  return esp_timer_get_time();
+}
+
+// Sleep, rounded to the RTOS tick
+static inline void
+oled_delay_us(int64_t us)
+{
+  uint32_t tick_us = portTICK_PERIOD_MS * 1000;
+  TickType_t ticks = (us + tick_us / 2) / tick_us;
+  if (ticks > 0) {
+    vTaskDelay(ticks);
+  }
+}
+
+#else
+
+#include <stdio.h>
+#include <time.h>
+
+static inline int64_t
+oled_time_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline void
+oled_delay_us(int64_t us)
+{
+  struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+  if (us > 0) {
+    nanosleep(&ts, NULL);
+  }
+}
+
+#define ESP_LOGI(tag, format, ...) printf("I %s: " format "\n", tag, ##__VA_ARGS__)
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#define esp_timer_get_time()        oled_time_us()
+#define MALLOC_CAP_DMA              0
+#define heap_caps_malloc(size, cap) malloc(size)
+#define heap_caps_free(ptr)         free(ptr)
+
+// The tick is 1 ms, the timeout of a lock is always portMAX_DELAY
+#define portMAX_DELAY       0xFFFFFFFFu
+#define portTICK_PERIOD_MS  1
+#define pdPASS              1
+typedef uint32_t TickType_t;
+
+// Semaphore, a mutex is created given and a binary semaphore taken
+typedef struct oled_host_sem_t {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int count;
+} *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t
+oled_host_sem_create(int count)
+{
+  SemaphoreHandle_t sem = (SemaphoreHandle_t)malloc(sizeof(struct oled_host_sem_t));
+  if (sem != NULL) {
+    pthread_mutex_init(&sem->mutex, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = count;
+  }
+  return sem;
+}
+
+#define xSemaphoreCreateMutex()   oled_host_sem_create(1)
+#define xSemaphoreCreateBinary()  oled_host_sem_create(0)
+
+static inline int
+xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+  pthread_mutex_lock(&sem->mutex);
+  while (sem->count == 0) {
+    pthread_cond_wait(&sem->cond, &sem->mutex);
+  }
+  sem->count = 0;
+  pthread_mutex_unlock(&sem->mutex);
+  return 1;
+}
+
+static inline int
+xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  pthread_mutex_lock(&sem->mutex);
+  sem->count = 1;
+  pthread_cond_signal(&sem->cond);
+  pthread_mutex_unlock(&sem->mutex);
+  return 1;
+}
+
+static inline void
+vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+  pthread_cond_destroy(&sem->cond);
+  pthread_mutex_destroy(&sem->mutex);
+  free(sem);
+}
+
+static inline TickType_t
+xTaskGetTickCount(void)
+{
+  return (TickType_t)(oled_time_us() / 1000);
+}
+
+static inline void
+vTaskDelay(TickType_t ticks)
+{
+  oled_delay_us((int64_t)ticks * 1000);
+}
+
+static inline void
+vTaskDelayUntil(TickType_t *wake, TickType_t period)
+{
+  *wake += period;
+  // no delay if late
+  oled_delay_us((int64_t)(int32_t)(*wake - xTaskGetTickCount()) * 1000);
+}
+
+// Task on a detached thread, deleted by itself only
+typedef struct oled_host_task_t {
+  void (*func)(void *);
+  void *arg;
+} oled_host_task_t;
+
+static inline void *
+oled_host_task_main(void *ptr)
+{
+  oled_host_task_t task = *(oled_host_task_t *)ptr;
+  free(ptr);
+  task.func(task.arg);
+  return NULL;
+}
+
+static inline int
+xTaskCreate(void (*func)(void *), const char *name, uint32_t stack, void *arg, int priority, void *handle)
+{
+  pthread_t thread;
+  oled_host_task_t *task = (oled_host_task_t *)malloc(sizeof(oled_host_task_t));
+  if (task == NULL) {
+    return 0;
+  }
+  task->func = func;
+  task->arg = arg;
+  if (pthread_create(&thread, NULL, oled_host_task_main, task) != 0) {
+    free(task);
+    return 0;
+  }
+  pthread_detach(thread);
+  return pdPASS;
+}
+
+#define vTaskDelete(handle) pthread_exit(NULL)
+
+#endif /* ESP_PLATFORM */
+
+#endif /* OLED_PLATFORMH_ */
@@ -0,0 +1,192 @@
+#ifndef OLED_TRANSPORTH_
+#define OLED_TRANSPORTH_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Transfer result
+typedef enum {
+  XFER_OK,
+  XFER_TIMEOUT,             // the transaction was not queued or finished in time
+  XFER_ERROR                // the bus driver returned an error
+} xfer_err_t;
+
+// Transport type
+typedef enum {
+  OLED_BUS_SPI,
+  OLED_BUS_I2C,
+  OLED_BUS_MOCK
+} oled_bus_t;
+
+typedef struct oled_transport_t oled_transport_t;
+
+// Transport interface of the display controller.
+// The data sent by send_data_async stays valid until wait returns,
+// send_cmds and send_data_async wait for the data in flight first.
+typedef struct oled_transport_ops_t {
+  void (*begin)(oled_transport_t *t);   // start a frame, SPI selects the display
+  void (*end)(oled_transport_t *t);     // end a frame
+  xfer_err_t (*send_cmds)(oled_transport_t *t, const uint8_t *cmds, uint32_t len);
+  xfer_err_t (*send_data_async)(oled_transport_t *t, const uint8_t *data, uint32_t len);
+  xfer_err_t (*wait)(oled_transport_t *t);
+  void (*reset)(oled_transport_t *t);   // hardware reset of the display
+  xfer_err_t (*set_clock)(oled_transport_t *t, uint32_t clock_hz);  // between the frames
+  void (*free)(oled_transport_t *t);    // release the bus
+} oled_transport_ops_t;
+
+// Common part of the transports.
+// The transfer time of a transaction of len bytes is modeled as
+//
+//   overhead_ns + (framing_bytes + len) * bits_per_byte / clock_hz
+//
+// and the data longer than max_chunk is split into transactions.
+struct oled_transport_t {
+  const oled_transport_ops_t *ops;
+  oled_bus_t type;
+  uint32_t timeout_ms;      // transaction timeout [ms]
+  uint32_t timeouts;        // transactions timed out
+  int32_t last_error;       // last error of the bus driver
+  uint32_t clock_hz;        // bus clock [Hz]
+  uint32_t overhead_ns;     // driver cost per transaction [ns]
+  uint8_t bits_per_byte;    // 8 for SPI, 9 for I2C with ACK
+  uint8_t framing_bytes;    // bytes added to a transaction, I2C address and control byte
+  uint16_t max_chunk;       // longest data transaction [byte], 0 = no limit
+};
+
+// Transfer cost of a frame
+typedef struct oled_cost_t {
+  uint32_t transactions;
+  uint32_t cmd_bytes;
+  uint32_t data_bytes;
+  uint64_t time_ns;         // modeled transfer time [ns]
+} oled_cost_t;
+
+// Driver cost per transaction of the ESP-IDF drivers, measured roughly.
+// Tuned by the display for the panel and the build.
+#define OLED_SPI_OVERHEAD_NS    15000
+#define OLED_I2C_OVERHEAD_NS    60000
+
+// Set the transfer model of the bus type
+static inline void
+oled_model_init(oled_transport_t *t, oled_bus_t bus, uint32_t clock_hz, uint32_t overhead_ns)
+{
+  t->clock_hz = (clock_hz > 0) ? clock_hz : 1;
+  t->overhead_ns = overhead_ns;
+  t->bits_per_byte = (bus == OLED_BUS_I2C) ? 9 : 8;
+  t->framing_bytes = (bus == OLED_BUS_I2C) ? 2 : 0;
+}
+
+// Modeled transfer time of a transaction of len bytes [ns]
+static inline uint64_t
+oled_transaction_ns(const oled_transport_t *t, uint32_t len)
+{
+  uint64_t bits = (uint64_t)(t->framing_bytes + len) * t->bits_per_byte;
+  return t->overhead_ns + bits * 1000000000 / t->clock_hz;
+}
+
+static inline void
+oled_begin(oled_transport_t *t)
+{
+  t->ops->begin(t);
+}
+
+static inline void
+oled_end(oled_transport_t *t)
+{
+  t->ops->end(t);
+}
+
+static inline xfer_err_t
+oled_send_cmds(oled_transport_t *t, const uint8_t *cmds, uint32_t len)
+{
+  return t->ops->send_cmds(t, cmds, len);
+}
+
+static inline xfer_err_t
+oled_send_data_async(oled_transport_t *t, const uint8_t *data, uint32_t len)
+{
+  return t->ops->send_data_async(t, data, len);
+}
+
+static inline xfer_err_t
+oled_wait(oled_transport_t *t)
+{
+  return t->ops->wait(t);
+}
+
+static inline void
+oled_reset(oled_transport_t *t)
+{
+  t->ops->reset(t);
+}
+
+static inline xfer_err_t
+oled_set_clock(oled_transport_t *t, uint32_t clock_hz)
+{
+  return t->ops->set_clock(t, clock_hz);
+}
+
+static inline void
+oled_transport_free(oled_transport_t *t)
+{
+  if (t != NULL) {
+    t->ops->free(t);
+  }
+}
+
+// SPI, D/C line and CS driven by GPIO, 4-wire mode.
+// dma_ch = 0 sends up to 32 bytes per transaction.
+typedef struct oled_spi_config_t {
+  int8_t cs;
+  int8_t dc;
+  int8_t rst;
+  int8_t mosi;
+  int8_t sck;
+  int8_t miso;
+  uint32_t freq;            // SPI clock [Hz]
+  uint8_t mode;             // SPI mode (0-3)
+  uint8_t dma_ch;           // No DMA or DMA channel (1 or 2)
+} oled_spi_config_t;
+
+// I2C, the commands and the data are framed by the control byte.
+typedef struct oled_i2c_config_t {
+  uint8_t port;             // I2C port number
+  int8_t sda;
+  int8_t scl;
+  int8_t rst;               // -1 if not wired
+  uint8_t addr;             // 7-bit address, 0x3C or 0x3D
+  uint32_t freq;            // SCL clock [Hz]
+} oled_i2c_config_t;
+
+// Built only on ESP-IDF
+#ifdef ESP_PLATFORM
+oled_transport_t *oled_spi_create(const oled_spi_config_t *cfg);
+oled_transport_t *oled_i2c_create(const oled_i2c_config_t *cfg);
+#endif
+
+// Mock, records the traffic and simulates the transfer time
+// by the model of the base
+typedef struct oled_mock_t {
+  oled_transport_t base;
+  uint8_t *log;             // traffic log, see oled_mock_create
+  uint32_t log_size;
+  uint32_t log_used;
+  uint32_t log_dropped;     // transactions not logged, the log was full
+  uint32_t transactions;
+  uint32_t cmd_bytes;
+  uint32_t data_bytes;
+  uint32_t frames;
+  uint32_t resets;
+  uint64_t sim_time_ns;     // simulated transfer time [ns]
+} oled_mock_t;
+
+// Traffic log record kind, followed by the length (u16 little endian)
+// and the bytes of the transaction.
+#define OLED_MOCK_CMDS      'C'
+#define OLED_MOCK_DATA      'D'
+#define OLED_MOCK_RESET     'R'
+
+oled_transport_t *oled_mock_create(oled_bus_t bus, uint32_t clock_hz, uint32_t overhead_ns, uint32_t log_size);
+void oled_mock_clear(oled_mock_t *mock);
+
+#endif /* OLED_TRANSPORTH_ */
@@ -5,40 +5,90 @@
 #include <mruby/value.h>
 #include <mruby/variable.h>
 #include <mruby/data.h>
+#include <mruby/hash.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "esp_log.h"
-#include "driver/spi_master.h"
-#include "soc/gpio_struct.h"
-#include "driver/gpio.h"
-#include "esp_heap_caps.h"
+#include "oled_platform.h"
 
 #include "tiny_grafx.h"
+#include "ssd1306.h"
+#include "oled_transport.h"
+#include "frame_recorder.h"
+#include "frame_sched.h"
+#include "dither.h"
+#include "widgets.h"
+#include "console.h"
+#include "chart.h"
 
 // SSD1306 display config
-#define SSD1306_DISPLAY_WIDTH   128
-#define SSD1306_DISPLAY_HEIGHT  64
-#define SSD1306_DISPLAY_PIXEL   1024
+#ifdef TG_FIXED_GEOMETRY
+#define SSD1306_DISPLAY_WIDTH   TG_WIDTH    // the only panel size of the build
+#define SSD1306_DISPLAY_HEIGHT  TG_HEIGHT
+#else
+#define SSD1306_DISPLAY_WIDTH   128   // default panel width
+#define SSD1306_DISPLAY_HEIGHT  64    // default panel height
+#endif
 #define SSD1306_FONT_WIDTH      8
 #define SSD1306_FONT_HEIGHT     8 
 
-// D/C pin mode, command or data
-enum {
-    DC_CMD,
-    DC_DATA
-};
+// Supported panel height range (MUX ratio 16 to 64)
+#define PANEL_MIN_HEIGHT    16
+#define PANEL_MAX_HEIGHT    64
+
+// Frame recorder defaults
+#define RECORDER_RING_SIZE          8192    // ring buffer size [byte]
+#define RECORDER_KEYFRAME_INTERVAL  32      // keyframe every 32 frames
+#define RECORDER_DUMP_VERSION       1
+#define RECORDER_DUMP_HEADER_SIZE   12
+
+// Temporal grayscale defaults
+#define GRAY_DEFAULT_LEVELS     4
+#define GRAY_DEFAULT_RATE       100     // bit-plane refresh rate [Hz]
+#define GRAY_TASK_STACK_SIZE    2048
+#define GRAY_TASK_PRIORITY      5
+
+// Column offset is chosen by the controller
+#define COL_OFFSET_AUTO     -1
+
+#define DEFAULT_CONTRAST    0x7F
+
+// Frame buffer pool, statically reserved in the DMA capable internal RAM.
+// Built with SSD1306_STATIC_FB_SIZE=<bytes> (see mrbgem.rake), the frame
+// buffers are taken from the pool and fall back to the heap if it is full.
+#ifdef SSD1306_STATIC_FB_SIZE
+#define FB_POOL_MAX_BLOCKS  4
+
+DMA_ATTR static uint8_t fb_pool[SSD1306_STATIC_FB_SIZE];
+static struct {
+  uint32_t offset;
+  uint32_t size;
+} fb_pool_blocks[FB_POOL_MAX_BLOCKS];   // blocks in use, sorted by offset
+static uint8_t fb_pool_count;
+#endif
 
 // DMA channel
 #define NO_DMA  0
 #define DMA_CH1 1
 #define DMA_CH2 2
 
-// NO_DMA mode transaction data size is up to 32 bytes at a time.
-#define NO_DMA_TRANSACTION_DATA_SIZE 32 
+// Transfer defaults
+#define XFER_DEFAULT_TIMEOUT_MS 1000    // per transaction
+#define XFER_DEFAULT_RETRIES    0       // frame is not sent again
+#define XFER_DEFAULT_BACKOFF_MS 10      // first retry delay, doubled on each retry
+#define XFER_MAX_RETRIES        8
+
+// Transfer statistics
+typedef struct xfer_stats_t {
+  uint32_t frames;          // frames sent
+  uint32_t failed;          // frames failed after the retries
+  uint32_t retries;         // frames sent again
+  uint32_t skipped_bytes;   // bytes of the unchanged pages not sent
+} xfer_stats_t;
+
+// Pages of the drawing area hashed by display, up to 128 rows rotated
+#define FRAME_HASH_PAGES    16
 
 // default SSD1306 wiring and SPI configuration
 #define SSD1306SPI_PIN_NUM_CS   5
@@ -51,10 +101,18 @@ enum {
 #define SSD1306SPI_SPI_MODE 0
 #define SSD1306SPI_DMA DMA_CH1                     // default DMA channel = 1
 
-// SPI HOST, only HSPI or VSPI
-#define SSD1306SPI_HOST VSPI_HOST
+// I2C defaults
+#define SSD1306I2C_PORT         0
+#define SSD1306I2C_PIN_NUM_SDA  21
+#define SSD1306I2C_PIN_NUM_SCL  22
+#define SSD1306I2C_ADDR         0x3C
+#define SSD1306I2C_CLOCK_SPEED_HZ (400*1000)      // Fast mode
+
+// Mock defaults
+#define MOCK_OVERHEAD_NS        20000   // per transaction [ns]
+#define MOCK_LOG_SIZE           4096    // traffic log [byte]
 
-// SPI Object
+// Display Object, the pins are of SPI or I2C
 typedef struct spi_config_t {
   uint8_t num_cs;           // Chip Select pin num
   uint8_t num_dc;           // Data/Command select pin num
@@ -65,13 +123,94 @@ typedef struct spi_config_t {
   uint32_t spi_freq;        // SPI clock frequency [Hz]
   uint8_t spi_mode;         // SPI mode (0-3)
   uint8_t dma_ch;           // No DMA or DMA channel (1 or 2)
-  bool require_reset;       // Reset the display
-  spi_device_handle_t spi;  // Handle for a device on a SPI bus
+  ssd1306_t panel;          // Controller state and the transport
+  uint8_t retries;          // Retries of a failed frame
+  uint16_t backoff_ms;      // First retry delay [ms]
+  xfer_stats_t xfer;        // Transfer statistics
+  uint32_t page_hash[FRAME_HASH_PAGES]; // Hash of each page sent by display
+  uint32_t page_valid;      // Pages of page_hash shown on the panel, bit per page
   tinygrafx_t tinygrafx;    // Tiny graphics config and frame buffer
+  bool opened;              // Display is ready, false after close
+  uint32_t generation;      // Changed by each open and the swap of the drawing area,
+                            // the console, the widgets and the chart redraw on it
+  bool fb_static;           // Frame buffer is in the static pool
+  uint8_t *xfer_buffer;     // Rotated frame for the transfer, only for 90 or 270 rotation
+  frame_recorder_t *recorder; // Frame recorder, NULL if not recording
+  uint32_t record_time_us;  // Time spent on encoding the recorded frames [us]
+  frame_sched_t sched;      // Frame scheduler
+  SemaphoreHandle_t bus_lock; // Serializes the frame pushes with the grayscale task
+  uint8_t *gray_planes;     // Temporal grayscale bit-planes, NULL if stopped
+  uint8_t gray_count;       // Number of bit-planes
+  TickType_t gray_period;   // Bit-plane period [tick]
+  volatile bool gray_running; // Grayscale task is running
+  SemaphoreHandle_t gray_done; // Given by the grayscale task on exit
 } spi_config_t;
 
 static const char *TAG = "SPI_SSD1306";
 
+// Set an Integer value to the statistics Hash
+#define HASH_SET_INT(h, key, val) \
+  mrb_hash_set(mrb, h, mrb_symbol_value(mrb_intern_lit(mrb, key)), mrb_fixnum_value(val))
+
+
+// Check the display is not closed
+static spi_config_t *
+display_open(mrb_state *mrb, spi_config_t *spicfg)
+{
+  if ((spicfg == NULL) || !spicfg->opened) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "display is closed");
+  }
+  return spicfg;
+}
+
+// Get the display of SSD1306 object
+static spi_config_t *
+get_spicfg(mrb_state *mrb, mrb_value self)
+{
+  return display_open(mrb, (spi_config_t *)DATA_PTR(self));
+}
+
+// Surface limits
+#define SURFACE_MAX_PANELS  8
+#define SURFACE_MAX_WIDTH   1024
+#define SURFACE_MAX_HEIGHT  256
+
+// Panel showing a region of the surface
+typedef struct surface_panel_t {
+  spi_config_t *spicfg;     // Display of the panel
+  int16_t x;                // Region of the panel on the surface,
+  int16_t y;                // y is a multiple of 8
+} surface_panel_t;
+
+// Surface Object, a frame buffer shown on several displays
+typedef struct surface_t {
+  tinygrafx_t tinygrafx;    // Tiny graphics config and frame buffer
+  surface_panel_t panels[SURFACE_MAX_PANELS];
+  uint8_t count;            // Number of the panels
+} surface_t;
+
+static void
+surface_free(mrb_state *mrb, void *ptr)
+{
+  surface_t *surface = ptr;
+  free(surface->tinygrafx.display_buffer);
+  mrb_free(mrb, surface);
+}
+
+static const struct mrb_data_type mrb_surface_type = {
+  "surface_type", surface_free
+};
+
+// Get the frame buffer of SSD1306 or Surface object to draw
+static tinygrafx_t *
+get_tinygrafx(mrb_state *mrb, mrb_value self)
+{
+  if (DATA_TYPE(self) == &mrb_surface_type) {
+    return &((surface_t *)DATA_PTR(self))->tinygrafx;
+  }
+  return &get_spicfg(mrb, self)->tinygrafx;
+}
+
 
 // ----- Common graphics methods ----------
 // mruby binding of manipulate the graphics
@@ -79,9 +218,9 @@ static const char *TAG = "SPI_SSD1306";
 static mrb_value
 lcd_clear(mrb_state *mrb, mrb_value self)
 {
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
 
-  buffer_clear(tg->tinygrafx);
+  buffer_clear(*tg);
   return self;
 }
 
@@ -90,11 +229,11 @@ lcd_set_pixel(mrb_state *mrb, mrb_value self)
 {
 	mrb_int x, y;
   int16_t color;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   mrb_get_args(mrb, "ii", &x, &y);
 	
-  set_pixel(tg->tinygrafx, x, y, color);
+  set_pixel(*tg, x, y, color);
   return mrb_nil_value();
 }
 
@@ -103,10 +242,10 @@ lcd_get_pixel(mrb_state *mrb, mrb_value self)
 {
 	mrb_int x, y;
   int16_t pixel;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   mrb_get_args(mrb, "ii", &x, &y);
 	
-  pixel = get_pixel(tg->tinygrafx, x, y);
+  pixel = get_pixel(*tg, x, y);
   return mrb_fixnum_value(pixel);
 }
 
@@ -115,14 +254,14 @@ lcd_draw_line(mrb_state *mrb, mrb_value self)
 {
   mrb_int x0, y0, x1, y1;
   int16_t color;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   mrb_get_args(mrb, "iiii", &x0, &y0, &x1, &y1);
   if ((color < BLACK) || (color > INVERT)) {
     color = WHITE;
   }
   
-  draw_line(tg->tinygrafx, x0, y0, x1, y1, color);
+  draw_line(*tg, x0, y0, x1, y1, color);
   return mrb_nil_value();
 }
 
@@ -131,11 +270,11 @@ lcd_draw_vertical_line(mrb_state *mrb, mrb_value self)
 {
 	mrb_int x, y, h;
   int16_t color;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   mrb_get_args(mrb, "iii", &x, &y, &h);
 	
-  draw_vertical_line(tg->tinygrafx, x, y, h, color);
+  draw_vertical_line(*tg, x, y, h, color);
   return mrb_nil_value();
 }
 
@@ -144,11 +283,11 @@ lcd_draw_horizontal_line(mrb_state *mrb, mrb_value self)
 {
 	mrb_int x, y, w;
   int16_t color;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   mrb_get_args(mrb, "iii", &x, &y, &w);
 	
-  draw_horizontal_line(tg->tinygrafx, x, y, w, color);
+  draw_horizontal_line(*tg, x, y, w, color);
 	return mrb_nil_value();
 }
 
@@ -157,11 +296,11 @@ lcd_draw_rect(mrb_state *mrb, mrb_value self)
 {
 	mrb_int x, y, w, h;
   int16_t color;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   mrb_get_args(mrb, "iiii", &x, &y, &w, &h);
 	
-  draw_rect(tg->tinygrafx, x, y, w, h, color);
+  draw_rect(*tg, x, y, w, h, color);
 	return mrb_nil_value();
 }
 
@@ -170,11 +309,11 @@ lcd_draw_fill_rect(mrb_state *mrb, mrb_value self)
 {
 	mrb_int x, y, w, h;
   int16_t color;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   mrb_get_args(mrb, "iiii", &x, &y, &w, &h);
 	
-  draw_fill_rect(tg->tinygrafx, x, y, w, h, color);
+  draw_fill_rect(*tg, x, y, w, h, color);
 	return mrb_nil_value();
 }
 
@@ -183,11 +322,11 @@ lcd_draw_circle(mrb_state *mrb, mrb_value self)
 {
 	mrb_int x, y, r;
   int16_t color;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   mrb_get_args(mrb, "iii", &x, &y, &r);
 	
-  draw_circle(tg->tinygrafx, x, y, r, color);
+  draw_circle(*tg, x, y, r, color);
 	return mrb_nil_value();
 }
 
@@ -196,11 +335,11 @@ lcd_draw_fill_circle(mrb_state *mrb, mrb_value self)
 {
   mrb_int x, y, r;
   int16_t color;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   mrb_get_args(mrb, "iii", &x, &y, &r);
 	
-  draw_fill_circle(tg->tinygrafx, x, y, r, color);
+  draw_fill_circle(*tg, x, y, r, color);
 	return mrb_nil_value();
 }
 
@@ -211,12 +350,12 @@ lcd_text(mrb_state *mrb, mrb_value self)
   mrb_int x, y;
   mrb_value data;
   int16_t color, fontsize;
-  spi_config_t *tg = (spi_config_t *)DATA_PTR(self);
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
   color = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@color")));
   fontsize = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@fontsize")));
   mrb_get_args(mrb, "iiS", &x, &y, &data);
   
-  display_text(tg->tinygrafx, x, y, RSTRING_PTR(data), RSTRING_LEN(data), color, fontsize);
+  display_text(*tg, x, y, RSTRING_PTR(data), RSTRING_LEN(data), color, fontsize);
   // ESP_LOGI(TAG, "color:%d, size:%d, text:%s", color, fontsize, RSTRING_PTR(data));
   return mrb_nil_value();
 }
@@ -228,337 +367,2022 @@ lcd_text(mrb_state *mrb, mrb_value self)
 // ----- SSD1306 methods and functions -----
 
 
-// Send buffer data to the display
-// NOTE: NO_DMA mode can transmit up to 32 bytes at a time.
+// Allocate a buffer sent to the display, DMA capable if DMA is used
+static uint8_t *
+xfer_malloc(spi_config_t *spicfg, uint32_t size)
+{
+  if (spicfg->dma_ch == NO_DMA) {
+    return (uint8_t *)malloc(size);
+  }
+  return (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_DMA);
+}
+
 static void
-send_data(spi_config_t *spicfg, const uint8_t *data, int16_t len, int32_t dc)
-{
-  esp_err_t err;
-  spi_transaction_t tx;
-
-  // spi pre-transfer setting, control lines.
-  gpio_set_level(spicfg->num_cs, 0);
-  gpio_set_level(spicfg->num_dc, dc);
-
-  if (spicfg->dma_ch == 0) {
-    // NO_DMA mode
-    int16_t max_len, tx_len, left_len;
-    void *cur_data = (void *)data;
-    max_len = NO_DMA_TRANSACTION_DATA_SIZE;
-    left_len = len;
-
-    while (left_len > 0) {
-      tx_len = (left_len > max_len) ? max_len : left_len;
-      memset(&tx, 0, sizeof(tx));
-      tx.length = tx_len * 8;   // tx_len is in bytes, transaction length is in bits.
-      tx.tx_buffer = cur_data;  // Transmit data
-      tx.user = (void*)dc;      // D/C needs to be set to 1
-      err = spi_device_queue_trans(spicfg->spi, &tx, 1000 / portTICK_PERIOD_MS);
-      if (err != ESP_OK) {
-        ESP_LOGI(TAG, "send_data: spi_device_queue_trans error=%d", err);
-      }
-      
-      spi_transaction_t *rx;
-      err = spi_device_get_trans_result(spicfg->spi, &rx, 1000 / portTICK_PERIOD_MS);
-      if (err != ESP_OK) {
-        ESP_LOGI(TAG, "send_data: spi_device_get_trans_result error=%d", err);
-      }
-      left_len -= tx_len;
-      cur_data += tx_len;
-    }
+xfer_free(spi_config_t *spicfg, uint8_t *buffer)
+{
+  if (spicfg->dma_ch == NO_DMA) {
+    free(buffer);
   } else {
-    // Use DMA mode
-    memset(&tx, 0, sizeof(tx));
-    tx.length = len * 8;        // len is in bytes, transaction length is in bits.
-    tx.tx_buffer = data;        // Transmit data
-    tx.user = (void*)dc;        // D/C needs to be set to 1
-    err = spi_device_queue_trans(spicfg->spi, &tx, 1000 / portTICK_PERIOD_MS);
-    if (err != ESP_OK) {
-      ESP_LOGI(TAG, "send_data: spi_device_queue_trans error=%d", err);
+    heap_caps_free(buffer);
+  }
+}
+
+// Send the pending control commands without a frame
+static xfer_err_t
+ssd1306_send_cmds(spi_config_t *spicfg)
+{
+  xSemaphoreTake(spicfg->bus_lock, portMAX_DELAY);
+  xfer_err_t err = ssd1306_flush_cmds(&spicfg->panel);
+  xSemaphoreGive(spicfg->bus_lock);
+  return err;
+}
+
+// Rotate the frame to the panel, with the bus locked.
+// Returns the panel buffer to send.
+static const uint8_t *
+ssd1306_frame_rotate(spi_config_t *spicfg, const uint8_t *frame)
+{
+  tinygrafx_t tg = spicfg->tinygrafx;
+  tg.display_buffer = (uint8_t *)frame;
+
+  if ((spicfg->panel.rotation == 90) || (spicfg->panel.rotation == 270)) {
+    buffer_read_rotate(tg, spicfg->xfer_buffer, spicfg->panel.rotation);
+    return spicfg->xfer_buffer;
+  }
+  return frame;
+}
+
+// Rotate the frame to the panel and record it, with the bus locked.
+// Returns the panel buffer to send.
+static const uint8_t *
+ssd1306_frame_prepare(spi_config_t *spicfg, const uint8_t *frame)
+{
+  const uint8_t *buffer = ssd1306_frame_rotate(spicfg, frame);
+
+  if (spicfg->recorder != NULL) {
+    int64_t start = esp_timer_get_time();
+    frame_recorder_add(spicfg->recorder, buffer, xTaskGetTickCount() * portTICK_PERIOD_MS);
+    spicfg->record_time_us += esp_timer_get_time() - start;
+  }
+  return buffer;
+}
+
+// Send a frame buffer in the drawing area layout to display.
+// Only the rectangles of the drawing area are sent if count > 0.
+// The frame is sent as it is, it must be DMA capable if DMA is used.
+// A failed frame is sent again up to the retries, with doubling delays.
+// The bus is unlocked in the delays, for the grayscale task.
+// The frame is recorded if record, the bit-planes of the grayscale are not.
+// The number of data bytes sent is stored to sent.
+static xfer_err_t
+ssd1306_send_frame(spi_config_t *spicfg, const uint8_t *frame, const tinygrafx_rect_t *rects, uint8_t count, bool record, uint32_t *sent)
+{
+  xfer_err_t err;
+
+  xSemaphoreTake(spicfg->bus_lock, portMAX_DELAY);
+  const uint8_t *buffer = record ? ssd1306_frame_prepare(spicfg, frame) : ssd1306_frame_rotate(spicfg, frame);
+  uint8_t pending = spicfg->panel.pending;
+  for (uint8_t retry = 0; ; retry++) {
+    *sent = 0;
+    err = ssd1306_write_frame(&spicfg->panel, buffer, rects, count, sent);
+    if (err == XFER_OK) {
+      spicfg->xfer.frames++;
+      break;
     }
+    // the control commands are sent again with the frame
+    spicfg->panel.pending |= pending;
+    if (retry >= spicfg->retries) {
+      spicfg->xfer.failed++;
+      break;
+    }
+    spicfg->xfer.retries++;
+    xSemaphoreGive(spicfg->bus_lock);
+    vTaskDelay(((uint32_t)spicfg->backoff_ms << retry) / portTICK_PERIOD_MS);
+    xSemaphoreTake(spicfg->bus_lock, portMAX_DELAY);
+    // the rotated frame may be overwritten in the delay
+    buffer = ssd1306_frame_rotate(spicfg, frame);
+  }
+  xSemaphoreGive(spicfg->bus_lock);
+  return err;
+}
+
+// Raise OLED::TransferError
+static void
+raise_xfer_error(mrb_state *mrb, spi_config_t *spicfg, xfer_err_t err)
+{
+  struct RClass *e = mrb_class_get_under(mrb, mrb_module_get(mrb, "OLED"), "TransferError");
+  if (err == XFER_TIMEOUT) {
+    mrb_raise(mrb, e, "transfer timed out");
+  }
+  mrb_raisef(mrb, e, "transfer error %S", mrb_fixnum_value(spicfg->panel.bus->last_error));
+}
 
-    spi_transaction_t *rx;
-    err = spi_device_get_trans_result(spicfg->spi, &rx, 1000 / portTICK_PERIOD_MS);
-    if (err != ESP_OK) {
-      ESP_LOGI(TAG, "send_data: spi_device_get_trans_result error=%d", err);
+// Forget the hashes of the pages covered by the rectangles, all if count = 0.
+// The pages are sent by the next display.
+static void
+frame_hash_invalidate(spi_config_t *spicfg, const tinygrafx_rect_t *rects, uint8_t count)
+{
+  if (count == 0) {
+    spicfg->page_valid = 0;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    tinygrafx_rect_t r = rects[i];
+    if (rect_clip(spicfg->tinygrafx, &r)) {
+      for (int16_t page = r.y / 8; page <= (r.y + r.h - 1) / 8; page++) {
+        spicfg->page_valid &= ~(1UL << page);
+      }
     }
   }
-  // spi post-transfer setting, control lines.
-  gpio_set_level(spicfg->num_dc, 0);
-  gpio_set_level(spicfg->num_cs, 1);
 }
 
-// SSD1306 init commands
-DRAM_ATTR static const uint8_t ssd1306_address_init[] = {
-  0x20, 0x00,         // ADDR_MODE, 0x00 = Horizontal Mode
-  0x21, 0x00, 0x7F,   // COLUMN_ADDR, 0x00 = start, 0x7f = end
-  0x22, 0x00, 0x07    // PAGE_ADDR, 0x00 = start, 0x7f = end
-};
+// Find the pages changed since the last frame sent by display, as the
+// rectangles of the runs of the changed pages. hashes gets the hashes of
+// the pages. Returns the number of the rectangles, 0 if unchanged.
+static uint8_t
+frame_diff(spi_config_t *spicfg, uint32_t *hashes, tinygrafx_rect_t *rects)
+{
+  tinygrafx_t tg = spicfg->tinygrafx;
+  uint8_t count = 0;
+  bool run = false;
+
+  if (spicfg->gray_running) {
+    // the grayscale task overwrites the panel
+    spicfg->page_valid = 0;
+  }
+  for (int16_t page = 0; page < tg.display_pages; page++) {
+    hashes[page] = buffer_page_hash(tg, page);
+    bool changed = !(spicfg->page_valid & (1UL << page)) || (hashes[page] != spicfg->page_hash[page]);
+    if (changed && run) {
+      rects[count - 1].h += 8;
+    } else if (changed) {
+      rects[count++] = (tinygrafx_rect_t){ 0, page * 8, tg.display_width, 8 };
+    }
+    run = changed;
+  }
+  return count;
+}
 
-// Send buffer to display
+// The pages are shown on the panel
 static void
-ssd1306_send_display(spi_config_t *spicfg)
+frame_hash_commit(spi_config_t *spicfg, const uint32_t *hashes)
 {
-  uint8_t *buffer;
+  uint16_t pages = spicfg->tinygrafx.display_pages;
+
+  memcpy(spicfg->page_hash, hashes, pages * sizeof(uint32_t));
+  spicfg->page_valid = (1UL << pages) - 1;
+}
 
-  if (spicfg->dma_ch == 0) {
-    // NO DMA
-    buffer = (uint8_t *)malloc(spicfg->tinygrafx.display_pixel);
+// Send the changed pages of the frame from the diff.
+// The unchanged pages are counted as skipped.
+static xfer_err_t
+ssd1306_send_diff(spi_config_t *spicfg, const uint32_t *hashes, const tinygrafx_rect_t *rects, uint8_t count, uint32_t *sent)
+{
+  xfer_err_t err;
+
+  *sent = 0;
+  if (count == 0) {
+    // control commands are not held by a skipped frame
+    err = ssd1306_send_cmds(spicfg);
   } else {
-    // Use DMA_CH1 or DMA_CH2
-    buffer = (uint8_t *)heap_caps_malloc(spicfg->tinygrafx.display_pixel, MALLOC_CAP_DMA);
+    err = ssd1306_send_frame(spicfg, spicfg->tinygrafx.display_buffer, rects, count, true, sent);
   }
-
-  if (buffer != NULL) {
-    memset(buffer, 0x00, spicfg->tinygrafx.display_pixel);
-    buffer_read(spicfg->tinygrafx, buffer, spicfg->tinygrafx.display_pixel);
-    send_data(spicfg, ssd1306_address_init, sizeof(ssd1306_address_init), DC_CMD);
-    send_data(spicfg, buffer, spicfg->tinygrafx.display_pixel, DC_DATA);
+  if (err != XFER_OK) {
+    spicfg->page_valid = 0;
+    return err;
   }
+  frame_hash_commit(spicfg, hashes);
+  spicfg->xfer.skipped_bytes += spicfg->tinygrafx.display_pixel - *sent;
+  return XFER_OK;
+}
 
-  if (spicfg->dma_ch == 0) {
-    free(buffer);
-  } else {
-    heap_caps_free(buffer);
+// Send a frame from Ruby, raise OLED::TransferError if failed.
+// The pages sent are hashed again by the next display.
+// Returns the number of data bytes sent.
+static uint32_t
+ssd1306_push_frame(mrb_state *mrb, spi_config_t *spicfg, const tinygrafx_rect_t *rects, uint8_t count)
+{
+  uint32_t sent;
+  frame_hash_invalidate(spicfg, rects, count);
+  xfer_err_t err = ssd1306_send_frame(spicfg, spicfg->tinygrafx.display_buffer, rects, count, true, &sent);
+  if (err != XFER_OK) {
+    raise_xfer_error(mrb, spicfg, err);
   }
+  return sent;
 }
 
-// display the frame buffer
+// display the frame buffer, only the pages changed since the last display.
+// All pages are sent if force. Returns the number of data bytes sent.
 static mrb_value
 ssd1306_spi_display(mrb_state *mrb, mrb_value self)
 {
-  spi_config_t *spicfg = (spi_config_t *)DATA_PTR(self);
-  ssd1306_send_display(spicfg);
-  return mrb_nil_value();
+  mrb_bool force;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "b", &force);
+  uint32_t hashes[FRAME_HASH_PAGES];
+  tinygrafx_rect_t rects[FRAME_HASH_PAGES];
+  uint32_t sent;
+
+  if (force) {
+    spicfg->page_valid = 0;
+  }
+  uint8_t count = frame_diff(spicfg, hashes, rects);
+  xfer_err_t err = ssd1306_send_diff(spicfg, hashes, rects, count, &sent);
+  if (err != XFER_OK) {
+    raise_xfer_error(mrb, spicfg, err);
+  }
+  return mrb_fixnum_value(sent);
 }
 
-// Initialize the SPI manter
-static void
-spi_bus_init(spi_config_t *spicfg)
-{
-  spi_bus_config_t buscfg = {
-    .miso_io_num = spicfg->num_miso,
-    .mosi_io_num = spicfg->num_mosi,
-    .sclk_io_num = spicfg->num_sck,
-    .quadwp_io_num = -1,  // WP (Write Protect) signal, or -1 if not used.
-    .quadhd_io_num = -1   // HD (HolD) signal, or -1 if not used.
-  };
-  spi_device_interface_config_t devcfg = {
-    .clock_speed_hz = spicfg->spi_freq,
-    .mode = spicfg->spi_mode,
-    .spics_io_num = spicfg->num_cs,
-    .queue_size = 1
-  };
-  esp_err_t err;
-  spi_device_handle_t spi;
-  
-  // Initialize the SPI bus
-  err = spi_bus_initialize(SSD1306SPI_HOST, &buscfg, spicfg->dma_ch);
-  spicfg->require_reset = (err == ESP_ERR_INVALID_STATE) ? false : true;
-  if (err != ESP_OK) {
-    ESP_LOGI(TAG, "spi_bus_init: spi_bus_initialize status=%d", err);
-  }
+// display a part of the frame buffer
+static mrb_value
+ssd1306_spi_display_rect(mrb_state *mrb, mrb_value self)
+{
+  mrb_int x, y, w, h;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "iiii", &x, &y, &w, &h);
+  tinygrafx_rect_t r = { x, y, w, h };
+
+  uint32_t sent = ssd1306_push_frame(mrb, spicfg, &r, 1);
+  return mrb_fixnum_value(sent);
+}
+
+// ----- Control commands -----
+// The control commands are sent in the same CS window as the next frame,
+// or by flush. Only the last state is sent if changed several times.
 
-  // Attach the OLED to the SPI bus
-  err = spi_bus_add_device(SSD1306SPI_HOST, &devcfg, &spi);
-  if (err != ESP_OK) {
-    ESP_LOGI(TAG, "spi_bus_init: spi_bus_add_device status=%d", err);
+// Set the contrast (0-255)
+static mrb_value
+ssd1306_set_contrast(mrb_state *mrb, mrb_value self)
+{
+  mrb_int contrast;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "i", &contrast);
+  if ((contrast < 0) || (contrast > 255)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "contrast must be 0..255");
   }
 
-  // Save the SPI device handle to SPI Object.
-  spicfg->spi = spi;
+  spicfg->panel.contrast = contrast;
+  spicfg->panel.pending |= PENDING_CONTRAST;
+  return mrb_fixnum_value(contrast);
 }
 
-static void
-spi_deinit(spi_config_t *spicfg)
-{
-  free(spicfg->tinygrafx.display_buffer);
-  free(spicfg->spi);
-}
-
-// SSD1306 init commands
-DRAM_ATTR static const uint8_t ssd1306_init_cmds[] = {
-  0xAE,               // display OFF
-  0xA8, 0x3F,         // MUX ratio (0x3F = 64d -1d)
-  0xD3, 0x00,         // set display offset (no offset)
-  0x40,               // set display start line
-  0xA1,               // re-map, SEG0 is mapped to column address 127
-  0xC8,               // scan direction, reverse up-bottom
-  0xDA, 0x12,         // set COM pins (Alternative configuration, Disable L/R remap)
-  0x81, 0x7F,         // set contrast
-  0x2E,               // stop scrolling
-  0xA4,               // resume ram content display
-  0xD5, 0x00,         // set osc frequency
-  0x8D, 0x14,         // enable charge pump
-  0x20, 0x00,         // ADDR_MODE, 0x00 = Horizontal Mode
-  0x21, 0x00, 0x7F,   // COLUMN_ADDR, 0x00 = start, 0x7f = end
-  0x22, 0x00, 0x07,   // PAGE_ADDR, 0x00 = start, 0x7f = end
-  0xAF                // display ON
-};
+static mrb_value
+ssd1306_get_contrast(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  return mrb_fixnum_value(spicfg->panel.contrast);
+}
 
-// SSD1306 Initialize
-static void
-ssd1306_init(spi_config_t *spicfg)
+// Inverse display (true) or normal display (false)
+static mrb_value
+ssd1306_set_invert(mrb_state *mrb, mrb_value self)
 {
-  // Initialize non-SPI GPIOs
-  gpio_set_direction(spicfg->num_dc, GPIO_MODE_OUTPUT);
-  gpio_set_direction(spicfg->num_rst, GPIO_MODE_OUTPUT);
-  gpio_set_direction(spicfg->num_cs, GPIO_MODE_OUTPUT);
-  gpio_set_pull_mode(spicfg->num_cs, GPIO_PULLUP_ONLY);
+  mrb_bool inverted;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "b", &inverted);
 
-  // Reset the display if host not in use
-  if (spicfg->require_reset) {
-    gpio_set_level(spicfg->num_rst, 1);
-    gpio_set_level(spicfg->num_rst, 0);
-    vTaskDelay(10 / portTICK_PERIOD_MS);
-    gpio_set_level(spicfg->num_rst, 1);
-  }
+  spicfg->panel.inverted = inverted;
+  spicfg->panel.pending |= PENDING_INVERT;
+  return mrb_bool_value(inverted);
+}
+
+// Display ON (true) or sleep (false)
+static mrb_value
+ssd1306_set_power(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool power;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "b", &power);
 
-  // Send all commands
-  send_data(spicfg, ssd1306_init_cmds, sizeof(ssd1306_init_cmds), DC_CMD);
+  spicfg->panel.power = power;
+  spicfg->panel.pending |= PENDING_POWER;
+  return mrb_bool_value(power);
 }
 
-// Configuration the Tiny graphics libraries
-static void
-tinygrafx_init(spi_config_t *spicfg)
+// Mirror the display horizontally and/or vertically.
+// NOTE: the horizontal flip takes effect on the next frame data.
+static mrb_value
+ssd1306_flip(mrb_state *mrb, mrb_value self)
 {
-  tinygrafx_t tg = {
-    .display_width = SSD1306_DISPLAY_WIDTH,
-    .display_height = SSD1306_DISPLAY_HEIGHT,
-    .display_pixel = SSD1306_DISPLAY_PIXEL,
-    .font_width = SSD1306_FONT_WIDTH,
-    .font_height = SSD1306_FONT_HEIGHT
-  }; 
-  // set frame buffer
-  uint8_t *buffer;
-  buffer = (uint8_t *)malloc(tg.display_pixel);
-  if (buffer != NULL) {
-    memset(buffer, 0, tg.display_pixel);
+  mrb_bool flip_h, flip_v;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "bb", &flip_h, &flip_v);
+
+  spicfg->panel.flip_h = flip_h;
+  spicfg->panel.flip_v = flip_v;
+  spicfg->panel.pending |= PENDING_FLIP;
+  // the frame must be sent again in the new column mapping
+  spicfg->page_valid = 0;
+  return self;
+}
+
+// Rotate the display clockwise, 0, 90, 180 or 270 degree.
+// 180 is done by the display, 90 and 270 by transposing the frame buffer
+// on the transfer. The frame buffer is cleared on 90 or 270 rotation.
+static mrb_value
+ssd1306_set_rotation(mrb_state *mrb, mrb_value self)
+{
+  mrb_int rotation;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  tinygrafx_t *tg = &spicfg->tinygrafx;
+  mrb_get_args(mrb, "i", &rotation);
+  if ((rotation != 0) && (rotation != 90) && (rotation != 180) && (rotation != 270)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "rotation must be 0, 90, 180 or 270");
   }
-  tg.display_buffer = buffer; 
 
-  spicfg->tinygrafx = tg;
+  if (spicfg->gray_running) {
+    // the bit-planes are in the layout of the drawing area
+    mrb_raise(mrb, E_RUNTIME_ERROR, "stop the grayscale before the rotation");
+  }
+
+  bool portrait = (rotation == 90) || (rotation == 270);
+  if (portrait && (spicfg->panel.width % 8 != 0)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "90 or 270 rotation needs the width of multiple of 8");
+  }
+#ifdef TG_FIXED_GEOMETRY
+  // the drawing area is fixed, it is not swapped
+  if (portrait && (TG_WIDTH != TG_HEIGHT)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "90 or 270 rotation is not available in the fixed geometry build");
+  }
+#endif
+  // the rotated frame is transposed into the transfer buffer,
+  // it is kept only while rotated by 90 or 270
+  uint8_t *xfer = spicfg->xfer_buffer;
+  if (portrait && (xfer == NULL)) {
+    xfer = xfer_malloc(spicfg, tg->display_pixel);
+    if (xfer == NULL) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the transfer buffer");
+    }
+  }
+
+  // a frame may be in the retry delay of another task
+  xSemaphoreTake(spicfg->bus_lock, portMAX_DELAY);
+  if (portrait != (tg->display_width != spicfg->panel.width)) {
+    // swap the drawing area, the console and the widgets draw it again
+    tg->display_width = portrait ? spicfg->panel.height : spicfg->panel.width;
+    tg->display_height = portrait ? spicfg->panel.width : spicfg->panel.height;
+    tg->display_pages = tg->display_height / 8;
+    buffer_clear(*tg);
+    spicfg->generation++;
+  }
+  spicfg->panel.rotation = rotation;
+  spicfg->xfer_buffer = portrait ? xfer : NULL;
+  xSemaphoreGive(spicfg->bus_lock);
+  if (!portrait && (xfer != NULL)) {
+    xfer_free(spicfg, xfer);
+  }
+
+  spicfg->panel.pending |= PENDING_FLIP;
+  // the pages of the drawing area are changed
+  spicfg->page_valid = 0;
+  return mrb_fixnum_value(rotation);
 }
 
-// free mrb object for GC.
-static void
-meb_ssd1306_free(mrb_state *mrb, void *ptr)
+static mrb_value
+ssd1306_get_rotation(mrb_state *mrb, mrb_value self)
 {
-  spi_config_t *spicfg = ptr;
-  mrb_free(mrb, spicfg->tinygrafx.display_buffer);
-  mrb_free(mrb, spicfg->spi);
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  return mrb_fixnum_value(spicfg->panel.rotation);
 }
 
-// mruby data_type
-static const struct mrb_data_type mrb_spi_config_type = {
-  "spi_config_type", meb_ssd1306_free
-};
+// Drawing area width and height
+static mrb_value
+ssd1306_get_width(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(get_tinygrafx(mrb, self)->display_width);
+}
 
-// Initialize the SPI device for SSD1306
 static mrb_value
-ssd1306_spi_init(mrb_state *mrb, mrb_value self)
+ssd1306_get_height(mrb_state *mrb, mrb_value self)
 {
-  spi_config_t *spicfg = (spi_config_t *)DATA_PTR(self);
-  if (spicfg) {
-    mrb_free(mrb, spicfg);
+  return mrb_fixnum_value(get_tinygrafx(mrb, self)->display_height);
+}
+
+// Send the pending control commands now
+static mrb_value
+ssd1306_flush(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  xfer_err_t err = ssd1306_send_cmds(spicfg);
+  if (err != XFER_OK) {
+    raise_xfer_error(mrb, spicfg, err);
   }
-  DATA_PTR(self) = NULL;
+  return self;
+}
+// ----- Control commands -----
 
-  // Get config param
-  mrb_int cs, dc, rst, mosi, sck, miso, freq, spi_mode, dma_ch;
-  mrb_get_args(mrb, "iiiiiiiii", &cs, &dc, &rst, &mosi, &sck, &miso, &freq, &spi_mode, &dma_ch);
+// ----- Transfer errors -----
 
-  // SSD1306 SPI bus config
-  spicfg = (spi_config_t *)mrb_malloc(mrb, sizeof(spi_config_t));
-  spicfg->num_cs   = cs;
-  spicfg->num_dc   = dc;
-  spicfg->num_rst  = rst;
-  spicfg->num_mosi = mosi;
-  spicfg->num_sck  = sck;
-  spicfg->num_miso = miso;
-  spicfg->spi_freq = freq;
-  spicfg->spi_mode = spi_mode;
-  spicfg->dma_ch   = dma_ch;
-  DATA_TYPE(self) = &mrb_spi_config_type;
-  DATA_PTR(self)  = spicfg;
-  
-  // Initialize the SPI
-  spi_bus_init(spicfg);
+// Set the transaction timeout [ms]
+static mrb_value
+ssd1306_set_timeout(mrb_state *mrb, mrb_value self)
+{
+  mrb_int ms;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "i", &ms);
+  if (ms <= 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "timeout must be positive");
+  }
 
-  // Initialize the SSD1306
-  ssd1306_init(spicfg);
+  spicfg->panel.bus->timeout_ms = ms;
+  return mrb_fixnum_value(ms);
+}
 
-  // Initialize the TINYGRAFX
-  tinygrafx_init(spicfg);
-  
+// Send a failed frame again up to retries times,
+// waiting backoff [ms] and doubling it on each retry.
+static mrb_value
+ssd1306_set_retry(mrb_state *mrb, mrb_value self)
+{
+  mrb_int retries, backoff_ms = XFER_DEFAULT_BACKOFF_MS;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "i|i", &retries, &backoff_ms);
+  if ((retries < 0) || (retries > XFER_MAX_RETRIES)) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "retries must be 0..%S", mrb_fixnum_value(XFER_MAX_RETRIES));
+  }
+  if ((backoff_ms < 0) || (backoff_ms > UINT16_MAX)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid backoff");
+  }
+
+  spicfg->retries = retries;
+  spicfg->backoff_ms = backoff_ms;
   return self;
 }
 
-// // Object duplication method
-// static mrb_value
-// spi_init_copy(mrb_state *mrb, mrb_value copy)
-// {
-//   mrb_value src;
-//   mrb_get_args(mrb, "o", &src);
-//   if (mrb_obj_equal(mrb, copy, src)) return copy;
-//   if (!mrb_obj_is_instance_of(mrb, src, mrb_obj_class(mrb, copy))) {
-//     mrb_raise(mrb, E_TYPE_ERROR, "wrong argument class");
-//   }
-//   if (!DATA_PTR(copy)) {
-//     DATA_PTR(copy) = (spi_config_t *)mrb_malloc(mrb, sizeof(spi_config_t));
-//     DATA_TYPE(copy) = &mrb_spi_config_type;
-//   }
-//   *(spi_config_t *)DATA_PTR(copy) = *(spi_config_t *)DATA_PTR(src);
-//   return copy;
-// }
-
-// View config setting
+// Transfer statistics
 static mrb_value
-spi_view_config(mrb_state *mrb, mrb_value self)
+ssd1306_transfer_stats(mrb_state *mrb, mrb_value self)
 {
-  spi_config_t *spicfg = DATA_PTR(self);
-  mrb_value spi_param = mrb_ary_new_capa(mrb, 9);
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_cs));
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_dc));
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_rst));
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_mosi));
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_sck));
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_miso));
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->spi_freq));
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->spi_mode));
-  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->dma_ch));
-  return spi_param;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  xfer_stats_t *xfer = &spicfg->xfer;
+
+  mrb_value stats = mrb_hash_new(mrb);
+  HASH_SET_INT(stats, "frames", xfer->frames);
+  HASH_SET_INT(stats, "failed", xfer->failed);
+  HASH_SET_INT(stats, "retries", xfer->retries);
+  HASH_SET_INT(stats, "skipped_bytes", xfer->skipped_bytes);
+  HASH_SET_INT(stats, "timeouts", spicfg->panel.bus->timeouts);
+  HASH_SET_INT(stats, "last_error", spicfg->panel.bus->last_error);
+  return stats;
 }
+// ----- Transfer errors -----
 
-void
-mrb_mruby_esp32_spi_ssd1306_gem_init(mrb_state* mrb)
+// ----- Bus clock and transfer model -----
+
+// Set the bus clock [Hz], between the frames
+static mrb_value
+ssd1306_set_freq(mrb_state *mrb, mrb_value self)
 {
-  struct RClass *oled = mrb_define_module(mrb, "OLED");
-  mrb_define_const(mrb, oled, "BLACK", mrb_fixnum_value(BLACK));
-  mrb_define_const(mrb, oled, "WHITE", mrb_fixnum_value(WHITE));
-  mrb_define_const(mrb, oled, "INVERT", mrb_fixnum_value(INVERT));
+  mrb_int freq;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "i", &freq);
+  if (freq <= 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid clock frequency");
+  }
 
-  struct RClass *ssd1306 = mrb_define_class_under(mrb, oled, "SSD1306SPI", mrb->object_class);
-  MRB_SET_INSTANCE_TT(ssd1306, MRB_TT_DATA);
+  xSemaphoreTake(spicfg->bus_lock, portMAX_DELAY);
+  xfer_err_t err = oled_set_clock(spicfg->panel.bus, freq);
+  xSemaphoreGive(spicfg->bus_lock);
+  if (err != XFER_OK) {
+    raise_xfer_error(mrb, spicfg, err);
+  }
+  spicfg->spi_freq = freq;
+  return mrb_fixnum_value(freq);
+}
 
-  // Common graphics methods
-  mrb_define_method(mrb, ssd1306, "clear", lcd_clear, MRB_ARGS_NONE());
-  mrb_define_method(mrb, ssd1306, "set_pixel", lcd_set_pixel, MRB_ARGS_REQ(2));
-  mrb_define_method(mrb, ssd1306, "get_pixel", lcd_get_pixel, MRB_ARGS_REQ(2));
-  mrb_define_method(mrb, ssd1306, "line", lcd_draw_line, MRB_ARGS_REQ(4));
-  mrb_define_method(mrb, ssd1306, "vline", lcd_draw_vertical_line, MRB_ARGS_REQ(3));
-  mrb_define_method(mrb, ssd1306, "hline", lcd_draw_horizontal_line, MRB_ARGS_REQ(3));
-  mrb_define_method(mrb, ssd1306, "rect", lcd_draw_rect, MRB_ARGS_REQ(4));
-  mrb_define_method(mrb, ssd1306, "fill_rect", lcd_draw_fill_rect, MRB_ARGS_REQ(4));
-  mrb_define_method(mrb, ssd1306, "circle", lcd_draw_circle, MRB_ARGS_REQ(3));
-  mrb_define_method(mrb, ssd1306, "fill_circle", lcd_draw_fill_circle, MRB_ARGS_REQ(3));
-  mrb_define_method(mrb, ssd1306, "text", lcd_text, MRB_ARGS_REQ(3));
+static mrb_value
+ssd1306_get_freq(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  return mrb_fixnum_value(spicfg->panel.bus->clock_hz);
+}
 
-  // Send frame buffer to display
-  mrb_define_method(mrb, ssd1306, "display", ssd1306_spi_display, MRB_ARGS_NONE());
+// Set the driver cost per transaction of the model [ns]
+static mrb_value
+ssd1306_set_transaction_overhead(mrb_state *mrb, mrb_value self)
+{
+  mrb_int ns;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "i", &ns);
+  if (ns < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid overhead");
+  }
+
+  spicfg->panel.bus->overhead_ns = ns;
+  return mrb_fixnum_value(ns);
+}
 
-  // ssd1306 spi method
-  mrb_define_method(mrb, ssd1306, "_init", ssd1306_spi_init, MRB_ARGS_NONE());
+// Estimate the transfer cost of display, or display_rect with a rectangle
+static mrb_value
+ssd1306_frame_time_estimate(mrb_state *mrb, mrb_value self)
+{
+  mrb_int x = 0, y = 0, w = 0, h = 0;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_int argc = mrb_get_args(mrb, "|iiii", &x, &y, &w, &h);
+  tinygrafx_rect_t r = { x, y, w, h };
+  oled_cost_t cost;
+
+  if ((argc != 0) && (argc != 4)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "give no arguments or x, y, w, h");
+  }
+  ssd1306_estimate_frame(&spicfg->panel, spicfg->tinygrafx.display_buffer, &r, (argc == 4) ? 1 : 0, &cost);
+
+  mrb_value estimate = mrb_hash_new(mrb);
+  HASH_SET_INT(estimate, "transactions", cost.transactions);
+  HASH_SET_INT(estimate, "cmd_bytes", cost.cmd_bytes);
+  HASH_SET_INT(estimate, "data_bytes", cost.data_bytes);
+  HASH_SET_INT(estimate, "time_us", cost.time_ns / 1000);
+  return estimate;
+}
+// ----- Bus clock and transfer model -----
+
+// ----- Frame scheduler -----
+
+// Set the frame rate cap, 0 = no cap
+static mrb_value
+ssd1306_set_frame_rate(mrb_state *mrb, mrb_value self)
+{
+  mrb_int fps;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "i", &fps);
+  if (fps < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "frame rate must be positive");
+  }
+
+  frame_sched_set_rate(&spicfg->sched, fps);
+  return mrb_fixnum_value(fps);
+}
+
+// Start drawing a frame
+static mrb_value
+ssd1306_begin_frame(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  frame_sched_begin(&spicfg->sched);
+  return self;
+}
+
+// Send the changed pages of the frame, and wait for the next frame.
+// The last frame (last = true) is not dropped.
+// Returns true if the frame was sent.
+static mrb_value
+ssd1306_end_frame(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool last = false;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "|b", &last);
+  uint32_t hashes[FRAME_HASH_PAGES];
+  tinygrafx_rect_t rects[FRAME_HASH_PAGES];
+  uint8_t count = frame_diff(spicfg, hashes, rects);
+  bool push = frame_sched_need_push(&spicfg->sched, count > 0, last);
+
+  xfer_err_t err;
+  uint32_t sent;
+
+  if (push) {
+    int64_t start = esp_timer_get_time();
+    err = ssd1306_send_diff(spicfg, hashes, rects, count, &sent);
+    if (err == XFER_OK) {
+      frame_sched_pushed(&spicfg->sched, start);
+    }
+  } else if (count == 0) {
+    err = ssd1306_send_diff(spicfg, hashes, rects, 0, &sent);
+  } else {
+    // the dropped frame is sent by the next frame
+    err = ssd1306_send_cmds(spicfg);
+  }
+  if (err != XFER_OK) {
+    raise_xfer_error(mrb, spicfg, err);
+  }
+  frame_sched_wait(&spicfg->sched);
+  return mrb_bool_value(push);
+}
+
+// Frame scheduler statistics
+static mrb_value
+ssd1306_frame_stats(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  frame_sched_t *sched = &spicfg->sched;
+  mrb_float fps = (sched->interval_us > 0) ? (1000000.0 / sched->interval_us) : 0.0;
+
+  mrb_value stats = mrb_hash_new(mrb);
+  mrb_hash_set(mrb, stats, mrb_symbol_value(mrb_intern_lit(mrb, "fps")), mrb_float_value(mrb, fps));
+  HASH_SET_INT(stats, "interval_us", sched->interval_us);
+  HASH_SET_INT(stats, "jitter_us", sched->jitter_us);
+  HASH_SET_INT(stats, "draw_us", sched->draw_us);
+  HASH_SET_INT(stats, "transfer_us", sched->transfer_us);
+  HASH_SET_INT(stats, "frames", sched->frames);
+  HASH_SET_INT(stats, "pushed", sched->pushed);
+  HASH_SET_INT(stats, "skipped", sched->skipped);
+  HASH_SET_INT(stats, "dropped", sched->dropped);
+  return stats;
+}
+// ----- Frame scheduler -----
+
+// ----- Dithering and grayscale -----
+
+// Get the grayscale image String, w x h bytes
+static const uint8_t *
+gray_image_ptr(mrb_state *mrb, mrb_value data, mrb_int w, mrb_int h)
+{
+  if ((w <= 0) || (h <= 0) || (RSTRING_LEN(data) < w * h)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "grayscale image needs w * h bytes");
+  }
+  return (const uint8_t *)RSTRING_PTR(data);
+}
+
+// Render an 8-bit grayscale image with dithering
+static mrb_value
+lcd_image(mrb_state *mrb, mrb_value self)
+{
+  mrb_int x, y, w, h, method = DITHER_BAYER;
+  mrb_value data;
+  tinygrafx_t *tg = get_tinygrafx(mrb, self);
+  mrb_get_args(mrb, "iiiiS|i", &x, &y, &w, &h, &data, &method);
+  const uint8_t *gray = gray_image_ptr(mrb, data, w, h);
+
+  if (!dither_image(*tg, x, y, gray, w, h, method)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the dithering work area");
+  }
+  return mrb_nil_value();
+}
+
+// Push the bit-planes one by one at the fixed rate
+static void
+gray_task(void *arg)
+{
+  spi_config_t *spicfg = (spi_config_t *)arg;
+  TickType_t wake = xTaskGetTickCount();
+  uint8_t plane = 0;
+
+  while (spicfg->gray_running) {
+    // a failed bit-plane is counted in the transfer statistics,
+    // the bit-planes are not recorded
+    uint32_t sent;
+    ssd1306_send_frame(spicfg, spicfg->gray_planes + plane * spicfg->tinygrafx.display_pixel, NULL, 0, false, &sent);
+    plane = (plane + 1) % spicfg->gray_count;
+    vTaskDelayUntil(&wake, spicfg->gray_period);
+  }
+  xSemaphoreGive(spicfg->gray_done);
+  vTaskDelete(NULL);
+}
+
+// Stop the grayscale task and release the bit-planes
+static void
+gray_stop(spi_config_t *spicfg)
+{
+  if (spicfg->gray_planes == NULL) {
+    return;
+  }
+  spicfg->gray_running = false;
+  xSemaphoreTake(spicfg->gray_done, portMAX_DELAY);
+  vSemaphoreDelete(spicfg->gray_done);
+  xfer_free(spicfg, spicfg->gray_planes);
+  spicfg->gray_planes = NULL;
+  spicfg->gray_done = NULL;
+}
+
+// Show a full screen 8-bit grayscale image in 2 to 4 levels, by cycling
+// the bit-planes at the refresh rate in the background.
+static mrb_value
+ssd1306_gray_start(mrb_state *mrb, mrb_value self)
+{
+  mrb_int levels = GRAY_DEFAULT_LEVELS, rate = GRAY_DEFAULT_RATE;
+  mrb_value data;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  tinygrafx_t tg = spicfg->tinygrafx;
+  mrb_get_args(mrb, "S|ii", &data, &levels, &rate);
+  const uint8_t *gray = gray_image_ptr(mrb, data, tg.display_width, tg.display_height);
+  if ((levels < GRAY_MIN_LEVELS) || (levels > GRAY_MAX_LEVELS)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "levels must be 2..4");
+  }
+  if (rate <= 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "rate must be positive");
+  }
+
+  gray_stop(spicfg);
+  uint8_t *planes = xfer_malloc(spicfg, (levels - 1) * tg.display_pixel);
+  if (planes == NULL) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the bit-planes");
+  }
+  dither_gray_planes(tg, gray, levels, planes);
+
+  TickType_t period = 1000 / rate / portTICK_PERIOD_MS;
+  spicfg->gray_planes = planes;
+  spicfg->gray_count = levels - 1;
+  spicfg->gray_period = (period > 0) ? period : 1;
+  spicfg->gray_done = xSemaphoreCreateBinary();
+  spicfg->gray_running = true;
+  if (xTaskCreate(gray_task, "oled_gray", GRAY_TASK_STACK_SIZE, spicfg, GRAY_TASK_PRIORITY, NULL) != pdPASS) {
+    spicfg->gray_running = false;
+    vSemaphoreDelete(spicfg->gray_done);
+    xfer_free(spicfg, planes);
+    spicfg->gray_planes = NULL;
+    spicfg->gray_done = NULL;
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot start the grayscale task");
+  }
+  return self;
+}
+
+// Stop the grayscale, the frame buffer is shown by the next display
+static mrb_value
+ssd1306_gray_stop(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  gray_stop(spicfg);
+  spicfg->page_valid = 0;
+  return self;
+}
+// ----- Dithering and grayscale -----
+
+// ----- Frame recorder -----
+
+// Stop recording and release the recorder
+static void
+recorder_free(mrb_state *mrb, spi_config_t *spicfg)
+{
+  if (spicfg->recorder != NULL) {
+    // the grayscale task may be recording a frame
+    xSemaphoreTake(spicfg->bus_lock, portMAX_DELAY);
+    frame_recorder_deinit(spicfg->recorder);
+    mrb_free(mrb, spicfg->recorder);
+    spicfg->recorder = NULL;
+    xSemaphoreGive(spicfg->bus_lock);
+  }
+}
+
+// Start recording the displayed frames
+static mrb_value
+ssd1306_record_start(mrb_state *mrb, mrb_value self)
+{
+  mrb_int ring_size = RECORDER_RING_SIZE;
+  mrb_int keyframe_interval = RECORDER_KEYFRAME_INTERVAL;
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_get_args(mrb, "|ii", &ring_size, &keyframe_interval);
+  if ((ring_size <= 0) || (keyframe_interval <= 0) || (keyframe_interval > UINT16_MAX)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid recorder size");
+  }
+
+  recorder_free(mrb, spicfg);
+  frame_recorder_t *rec = (frame_recorder_t *)mrb_malloc(mrb, sizeof(frame_recorder_t));
+  if (!frame_recorder_init(rec, spicfg->tinygrafx.display_pixel, ring_size, keyframe_interval)) {
+    mrb_free(mrb, rec);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the frame recorder");
+  }
+  spicfg->recorder = rec;
+  spicfg->record_time_us = 0;
+  return self;
+}
+
+// Stop recording, the recorded frames are discarded
+static mrb_value
+ssd1306_record_stop(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  recorder_free(mrb, spicfg);
+  return self;
+}
+
+// Recorded frames as a String, replayed by tools/oled_replay.rb
+//   "OREC", version, pages, width (u16), records (u32), records...
+static mrb_value
+ssd1306_recording(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  frame_recorder_t *rec = spicfg->recorder;
+  if (rec == NULL) {
+    return mrb_nil_value();
+  }
+
+  mrb_value dump = mrb_str_new(mrb, NULL, RECORDER_DUMP_HEADER_SIZE + rec->used);
+  uint8_t *p = (uint8_t *)RSTRING_PTR(dump);
+  memcpy(p, "OREC", 4);
+  p[4] = RECORDER_DUMP_VERSION;
+  p[5] = spicfg->panel.pages;
+  p[6] = spicfg->panel.width;
+  p[7] = 0;
+  p[8] = rec->records & 0xFF;
+  p[9] = (rec->records >> 8) & 0xFF;
+  p[10] = (rec->records >> 16) & 0xFF;
+  p[11] = (rec->records >> 24) & 0xFF;
+  frame_recorder_read(rec, p + RECORDER_DUMP_HEADER_SIZE, rec->used);
+  return dump;
+}
+
+// Recorder statistics
+static mrb_value
+ssd1306_record_stats(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  frame_recorder_t *rec = spicfg->recorder;
+  if (rec == NULL) {
+    return mrb_nil_value();
+  }
+
+  mrb_value stats = mrb_hash_new(mrb);
+  HASH_SET_INT(stats, "frames", rec->frames);
+  HASH_SET_INT(stats, "records", rec->records);
+  HASH_SET_INT(stats, "dropped", rec->dropped);
+  HASH_SET_INT(stats, "used", rec->used);
+  HASH_SET_INT(stats, "raw_bytes", rec->raw_bytes);
+  HASH_SET_INT(stats, "encoded_bytes", rec->encoded_bytes);
+  HASH_SET_INT(stats, "encode_us", spicfg->record_time_us);
+  return stats;
+}
+// ----- Frame recorder -----
+
+// ----- Memory usage -----
+
+// RAM used by this display [byte]
+static mrb_value
+ssd1306_memory_usage(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  uint32_t frame = spicfg->tinygrafx.display_pixel;
+  uint32_t object = sizeof(spi_config_t);
+  uint32_t framebuffer = spicfg->fb_static ? 0 : frame;
+  uint32_t transfer = (spicfg->xfer_buffer != NULL) ? frame : 0;
+  uint32_t gray = (spicfg->gray_planes != NULL) ? spicfg->gray_count * frame : 0;
+  uint32_t recorder = 0;
+  if (spicfg->recorder != NULL) {
+    frame_recorder_t *rec = spicfg->recorder;
+    recorder = sizeof(frame_recorder_t) + rec->ring_size + rec->frame_size +
+               FRAME_RECORD_HEADER_SIZE + FRAME_DELTA_MAX_SIZE(rec->frame_size);
+  }
+
+  mrb_value usage = mrb_hash_new(mrb);
+  HASH_SET_INT(usage, "object", object);
+  HASH_SET_INT(usage, "framebuffer", framebuffer);
+  HASH_SET_INT(usage, "static_framebuffer", spicfg->fb_static ? frame : 0);
+  HASH_SET_INT(usage, "transfer", transfer);
+  HASH_SET_INT(usage, "grayscale", gray);
+  HASH_SET_INT(usage, "recorder", recorder);
+  HASH_SET_INT(usage, "heap", object + framebuffer + transfer + gray + recorder);
+  return usage;
+}
+// ----- Memory usage -----
+
+#ifdef SSD1306_STATIC_FB_SIZE
+// Take a block from the frame buffer pool, first fit.
+static uint8_t *
+fb_pool_alloc(uint32_t size)
+{
+  uint32_t offset = 0;
+  uint8_t i;
+
+  size = (size + 3) & ~3;               // keep the blocks word aligned
+  if (fb_pool_count >= FB_POOL_MAX_BLOCKS) {
+    return NULL;
+  }
+  for (i = 0; i < fb_pool_count; i++) {
+    if (fb_pool_blocks[i].offset - offset >= size) {
+      break;
+    }
+    offset = fb_pool_blocks[i].offset + fb_pool_blocks[i].size;
+  }
+  if (offset + size > SSD1306_STATIC_FB_SIZE) {
+    return NULL;
+  }
+  memmove(&fb_pool_blocks[i + 1], &fb_pool_blocks[i], (fb_pool_count - i) * sizeof(fb_pool_blocks[0]));
+  fb_pool_blocks[i].offset = offset;
+  fb_pool_blocks[i].size = size;
+  fb_pool_count++;
+  return fb_pool + offset;
+}
+
+static void
+fb_pool_free(uint8_t *buffer)
+{
+  for (uint8_t i = 0; i < fb_pool_count; i++) {
+    if (fb_pool + fb_pool_blocks[i].offset == buffer) {
+      fb_pool_count--;
+      memmove(&fb_pool_blocks[i], &fb_pool_blocks[i + 1], (fb_pool_count - i) * sizeof(fb_pool_blocks[0]));
+      return;
+    }
+  }
+}
+#endif
+
+// Allocate the frame buffer, from the static pool if built with it.
+// The frame buffer is sent without a copy, so it is DMA capable if DMA is used.
+static uint8_t *
+framebuffer_alloc(spi_config_t *spicfg, uint32_t size)
+{
+#ifdef SSD1306_STATIC_FB_SIZE
+  uint8_t *buffer = fb_pool_alloc(size);
+  if (buffer != NULL) {
+    spicfg->fb_static = true;
+    return buffer;
+  }
+  ESP_LOGI(TAG, "framebuffer_alloc: static pool is full, %u bytes from the heap", size);
+#endif
+  spicfg->fb_static = false;
+  return xfer_malloc(spicfg, size);
+}
+
+static void
+framebuffer_free(spi_config_t *spicfg, uint8_t *buffer)
+{
+#ifdef SSD1306_STATIC_FB_SIZE
+  if (spicfg->fb_static) {
+    fb_pool_free(buffer);
+    return;
+  }
+#endif
+  xfer_free(spicfg, buffer);
+}
+
+// Configuration the Tiny graphics libraries
+static void
+tinygrafx_init(spi_config_t *spicfg)
+{
+  tinygrafx_t tg = {
+    .display_width = spicfg->panel.width,
+    .display_height = spicfg->panel.height,
+    .display_pages = spicfg->panel.pages,
+    .display_pixel = (uint32_t)spicfg->panel.width * spicfg->panel.pages,
+    .font_width = SSD1306_FONT_WIDTH,
+    .font_height = SSD1306_FONT_HEIGHT
+  }; 
+  // set frame buffer
+  uint8_t *buffer;
+  buffer = framebuffer_alloc(spicfg, tg.display_pixel);
+  if (buffer != NULL) {
+    memset(buffer, 0, tg.display_pixel);
+  }
+  tg.display_buffer = buffer; 
+
+  spicfg->tinygrafx = tg;
+}
+
+// Release the SPI device and the buffers of the display.
+// The config itself is kept for the re-init, and freed by GC.
+static void
+ssd1306_release(mrb_state *mrb, spi_config_t *spicfg)
+{
+  gray_stop(spicfg);
+  recorder_free(mrb, spicfg);
+  oled_transport_free(spicfg->panel.bus);
+  spicfg->panel.bus = NULL;
+  xfer_free(spicfg, spicfg->xfer_buffer);
+  spicfg->xfer_buffer = NULL;
+  framebuffer_free(spicfg, spicfg->tinygrafx.display_buffer);
+  spicfg->tinygrafx.display_buffer = NULL;
+  if (spicfg->bus_lock != NULL) {
+    vSemaphoreDelete(spicfg->bus_lock);
+    spicfg->bus_lock = NULL;
+  }
+  spicfg->opened = false;
+}
+
+// free mrb object for GC.
+static void
+meb_ssd1306_free(mrb_state *mrb, void *ptr)
+{
+  spi_config_t *spicfg = ptr;
+  if (spicfg == NULL) {
+    return;
+  }
+  ssd1306_release(mrb, spicfg);
+  mrb_free(mrb, spicfg);
+}
+
+// mruby data_type
+static const struct mrb_data_type mrb_spi_config_type = {
+  "spi_config_type", meb_ssd1306_free
+};
+
+// Check the panel geometry.
+// Returns the column offset, chosen by the controller if COL_OFFSET_AUTO.
+static mrb_int
+check_geometry(mrb_state *mrb, mrb_int controller, mrb_int width, mrb_int height, mrb_int col_offset)
+{
+  mrb_int ram_width;
+  switch (controller) {
+    case CTRL_SSD1306: ram_width = SSD1306_RAM_WIDTH; break;
+    case CTRL_SH1106:  ram_width = SH1106_RAM_WIDTH; break;
+    default: mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown controller: %S", mrb_fixnum_value(controller));
+  }
+  if ((width < 1) || (width > ram_width)) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "width must be 1..%S", mrb_fixnum_value(ram_width));
+  }
+  if ((height < PANEL_MIN_HEIGHT) || (height > PANEL_MAX_HEIGHT) || (height % 8 != 0)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "height must be a multiple of 8 in 16..64");
+  }
+#ifdef TG_FIXED_GEOMETRY
+  if ((width != TG_WIDTH) || (height != TG_HEIGHT)) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "this build is fixed to %Sx%S panel",
+               mrb_fixnum_value(TG_WIDTH), mrb_fixnum_value(TG_HEIGHT));
+  }
+#endif
+  if (col_offset == COL_OFFSET_AUTO) {
+    // center the panel in the column RAM, e.g. 64x48 => 32, SH1106 128x64 => 2
+    col_offset = (ram_width - width) / 2;
+  }
+  if ((col_offset < 0) || (col_offset + width > ram_width)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "col_offset is out of the column RAM");
+  }
+  return col_offset;
+}
+
+// Set up the config of the object for the panel.
+// Re-init on the same object keeps the config for the console and the
+// widgets, they check the generation and the geometry on each call.
+static spi_config_t *
+display_prepare(mrb_state *mrb, mrb_value self, mrb_int controller, mrb_int width, mrb_int height, mrb_int col_offset)
+{
+  spi_config_t *spicfg = (spi_config_t *)DATA_PTR(self);
+
+  col_offset = check_geometry(mrb, controller, width, height, col_offset);
+  if (spicfg != NULL) {
+    uint32_t generation = spicfg->generation;
+    ssd1306_release(mrb, spicfg);
+    memset(spicfg, 0, sizeof(spi_config_t));
+    spicfg->generation = generation + 1;
+  } else {
+    spicfg = (spi_config_t *)mrb_calloc(mrb, 1, sizeof(spi_config_t));
+  }
+
+  spicfg->panel.controller = controller;
+  spicfg->panel.width      = width;
+  spicfg->panel.height     = height;
+  spicfg->panel.pages      = height / 8;
+  spicfg->panel.col_offset = col_offset;
+  spicfg->panel.contrast   = DEFAULT_CONTRAST;
+  spicfg->panel.power      = true;
+  spicfg->retries    = XFER_DEFAULT_RETRIES;
+  spicfg->backoff_ms = XFER_DEFAULT_BACKOFF_MS;
+  spicfg->bus_lock   = xSemaphoreCreateMutex();
+  DATA_TYPE(self) = &mrb_spi_config_type;
+  DATA_PTR(self)  = spicfg;
+  return spicfg;
+}
+
+// Initialize the display on the transport
+static void
+display_start(mrb_state *mrb, spi_config_t *spicfg, oled_transport_t *bus)
+{
+  if (bus == NULL) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot open the display bus");
+  }
+  bus->timeout_ms = XFER_DEFAULT_TIMEOUT_MS;
+  spicfg->panel.bus = bus;
+
+  // Initialize the SSD1306
+  xfer_err_t err = ssd1306_init(&spicfg->panel);
+  if (err != XFER_OK) {
+    raise_xfer_error(mrb, spicfg, err);
+  }
+
+  // Initialize the TINYGRAFX
+  tinygrafx_init(spicfg);
+  if (spicfg->tinygrafx.display_buffer == NULL) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the frame buffer");
+  }
+  spicfg->opened = true;
+}
+
+// Initialize the SPI device for SSD1306
+static mrb_value
+ssd1306_spi_init(mrb_state *mrb, mrb_value self)
+{
+  // Get config param
+  mrb_int cs, dc, rst, mosi, sck, miso, freq, spi_mode, dma_ch;
+  mrb_int width, height, controller, col_offset;
+  mrb_get_args(mrb, "iiiiiiiiiiiii", &cs, &dc, &rst, &mosi, &sck, &miso, &freq, &spi_mode, &dma_ch,
+               &width, &height, &controller, &col_offset);
+  spi_config_t *spicfg = display_prepare(mrb, self, controller, width, height, col_offset);
+
+  // SSD1306 SPI bus config
+  spicfg->num_cs   = cs;
+  spicfg->num_dc   = dc;
+  spicfg->num_rst  = rst;
+  spicfg->num_mosi = mosi;
+  spicfg->num_sck  = sck;
+  spicfg->num_miso = miso;
+  spicfg->spi_freq = freq;
+  spicfg->spi_mode = spi_mode;
+  spicfg->dma_ch   = dma_ch;
+  oled_spi_config_t cfg = {
+    .cs = cs, .dc = dc, .rst = rst, .mosi = mosi, .sck = sck, .miso = miso,
+    .freq = freq, .mode = spi_mode, .dma_ch = dma_ch
+  };
+
+#ifdef ESP_PLATFORM
+  display_start(mrb, spicfg, oled_spi_create(&cfg));
+#else
+  mrb_raise(mrb, E_NOTIMP_ERROR, "SPI is not available on the host, use SSD1306Mock");
+#endif
+  return self;
+}
+
+// Initialize the I2C device for SSD1306
+static mrb_value
+ssd1306_i2c_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_int port, sda, scl, rst, addr, freq;
+  mrb_int width, height, controller, col_offset;
+  mrb_get_args(mrb, "iiiiiiiiii", &port, &sda, &scl, &rst, &addr, &freq,
+               &width, &height, &controller, &col_offset);
+  spi_config_t *spicfg = display_prepare(mrb, self, controller, width, height, col_offset);
+
+  // the I2C pins are shown by config? as MOSI (SDA) and SCK (SCL)
+  spicfg->num_mosi = sda;
+  spicfg->num_sck  = scl;
+  spicfg->num_rst  = rst;
+  spicfg->spi_freq = freq;
+  spicfg->dma_ch   = NO_DMA;
+  oled_i2c_config_t cfg = {
+    .port = port, .sda = sda, .scl = scl, .rst = rst, .addr = addr, .freq = freq
+  };
+
+#ifdef ESP_PLATFORM
+  display_start(mrb, spicfg, oled_i2c_create(&cfg));
+#else
+  mrb_raise(mrb, E_NOTIMP_ERROR, "I2C is not available on the host, use SSD1306Mock");
+#endif
+  return self;
+}
+
+// Initialize the mock display of SPI or I2C bus
+static mrb_value
+ssd1306_mock_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_int freq, bus, overhead_ns, log_size;
+  mrb_int width, height, controller, col_offset;
+  mrb_get_args(mrb, "iiiiiiii", &freq, &bus, &overhead_ns, &log_size,
+               &width, &height, &controller, &col_offset);
+  if ((freq <= 0) || ((bus != OLED_BUS_SPI) && (bus != OLED_BUS_I2C)) || (overhead_ns < 0) || (log_size < 0)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid mock config");
+  }
+  spi_config_t *spicfg = display_prepare(mrb, self, controller, width, height, col_offset);
+
+  spicfg->spi_freq = freq;
+  spicfg->dma_ch   = NO_DMA;
+  display_start(mrb, spicfg, oled_mock_create(bus, freq, overhead_ns, log_size));
+  return self;
+}
+
+// Release the display, open it again to use
+static mrb_value
+ssd1306_spi_close(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = (spi_config_t *)DATA_PTR(self);
+  if (spicfg != NULL) {
+    ssd1306_release(mrb, spicfg);
+  }
+  return mrb_nil_value();
+}
+
+static mrb_value
+ssd1306_spi_closed(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = (spi_config_t *)DATA_PTR(self);
+  return mrb_bool_value((spicfg == NULL) || !spicfg->opened);
+}
+
+// // Object duplication method
+// static mrb_value
+// spi_init_copy(mrb_state *mrb, mrb_value copy)
+// {
+//   mrb_value src;
+//   mrb_get_args(mrb, "o", &src);
+//   if (mrb_obj_equal(mrb, copy, src)) return copy;
+//   if (!mrb_obj_is_instance_of(mrb, src, mrb_obj_class(mrb, copy))) {
+//     mrb_raise(mrb, E_TYPE_ERROR, "wrong argument class");
+//   }
+//   if (!DATA_PTR(copy)) {
+//     DATA_PTR(copy) = (spi_config_t *)mrb_malloc(mrb, sizeof(spi_config_t));
+//     DATA_TYPE(copy) = &mrb_spi_config_type;
+//   }
+//   *(spi_config_t *)DATA_PTR(copy) = *(spi_config_t *)DATA_PTR(src);
+//   return copy;
+// }
+
+// View config setting
+static mrb_value
+spi_view_config(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  mrb_value spi_param = mrb_ary_new_capa(mrb, 13);
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_cs));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_dc));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_rst));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_mosi));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_sck));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->num_miso));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->panel.bus->clock_hz));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->spi_mode));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->dma_ch));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->panel.width));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->panel.height));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->panel.controller));
+  mrb_ary_push(mrb, spi_param, mrb_fixnum_value(spicfg->panel.col_offset));
+  return spi_param;
+}
+
+// ----- Text console -----
+
+// Console Object
+typedef struct console_obj_t {
+  spi_config_t *spicfg;     // Display of the console
+  uint32_t generation;      // Generation of the display drawn
+  console_t console;        // Character grid
+} console_obj_t;
+
+static void
+console_obj_free(mrb_state *mrb, void *ptr)
+{
+  console_obj_t *con = ptr;
+  console_free(&con->console);
+  mrb_free(mrb, con);
+}
+
+static const struct mrb_data_type mrb_console_type = {
+  "console_type", console_obj_free
+};
+
+// The display of the console, raise if the grid is not of it.
+// The cells are rendered again on the display opened again.
+static spi_config_t *
+console_display(mrb_state *mrb, console_obj_t *con)
+{
+  spi_config_t *spicfg = display_open(mrb, con->spicfg);
+  if (!console_fits(&con->console, spicfg->tinygrafx)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "console does not fit the display, create it again");
+  }
+  if (con->generation != spicfg->generation) {
+    console_invalidate(&con->console);
+    con->generation = spicfg->generation;
+  }
+  return spicfg;
+}
+
+// OLED::Console.new(oled)
+static mrb_value
+console_obj_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_value display;
+  mrb_get_args(mrb, "o", &display);
+  spi_config_t *spicfg = display_open(mrb, (spi_config_t *)mrb_data_get_ptr(mrb, display, &mrb_spi_config_type));
+
+  console_obj_t *con = (console_obj_t *)DATA_PTR(self);
+  if (con) {
+    console_obj_free(mrb, con);
+  }
+  DATA_PTR(self) = NULL;
+  con = (console_obj_t *)mrb_malloc(mrb, sizeof(console_obj_t));
+  if (!console_init(&con->console, spicfg->tinygrafx)) {
+    mrb_free(mrb, con);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the console");
+  }
+  con->spicfg = spicfg;
+  con->generation = spicfg->generation;
+  DATA_TYPE(self) = &mrb_console_type;
+  DATA_PTR(self)  = con;
+  // keep the display alive while the console is used
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "@display"), display);
+  console_clear(&con->console, spicfg->tinygrafx);
+  return self;
+}
+
+// Write a String at the cursor, shown by flush
+static mrb_value
+console_obj_write(mrb_state *mrb, mrb_value self)
+{
+  mrb_value data;
+  console_obj_t *con = (console_obj_t *)DATA_PTR(self);
+  mrb_get_args(mrb, "S", &data);
+
+  console_write(&con->console, console_display(mrb, con)->tinygrafx, (const uint8_t *)RSTRING_PTR(data), RSTRING_LEN(data));
+  return mrb_fixnum_value(RSTRING_LEN(data));
+}
+
+// Render the changed cells and send them to the display.
+// Returns the number of data bytes sent.
+static mrb_value
+console_obj_flush(mrb_state *mrb, mrb_value self)
+{
+  console_obj_t *con = (console_obj_t *)DATA_PTR(self);
+  spi_config_t *spicfg = console_display(mrb, con);
+  tinygrafx_rect_t damage;
+
+  if (!console_render(&con->console, spicfg->tinygrafx, &damage)) {
+    return mrb_fixnum_value(0);
+  }
+  uint32_t sent = ssd1306_push_frame(mrb, spicfg, &damage, 1);
+  return mrb_fixnum_value(sent);
+}
+
+static mrb_value
+console_obj_clear(mrb_state *mrb, mrb_value self)
+{
+  console_obj_t *con = (console_obj_t *)DATA_PTR(self);
+  console_clear(&con->console, console_display(mrb, con)->tinygrafx);
+  return self;
+}
+
+// Columns and rows
+static mrb_value
+console_obj_size(mrb_state *mrb, mrb_value self)
+{
+  console_obj_t *con = (console_obj_t *)DATA_PTR(self);
+  console_display(mrb, con);
+  mrb_value size = mrb_ary_new_capa(mrb, 2);
+  mrb_ary_push(mrb, size, mrb_fixnum_value(con->console.cols));
+  mrb_ary_push(mrb, size, mrb_fixnum_value(con->console.rows));
+  return size;
+}
+// ----- Text console -----
+
+// ----- Retained widgets -----
+
+// UI Object
+typedef struct ui_t {
+  spi_config_t *spicfg;     // Display of the widgets
+  uint32_t generation;      // Generation of the display drawn
+  uint16_t width, height;   // Drawing area drawn
+  widget_tree_t tree;       // Widgets
+} ui_t;
+
+static void
+ui_free(mrb_state *mrb, void *ptr)
+{
+  ui_t *ui = ptr;
+  widget_tree_free(&ui->tree);
+  mrb_free(mrb, ui);
+}
+
+static const struct mrb_data_type mrb_ui_type = {
+  "ui_type", ui_free
+};
+
+// OLED::UI.new(oled)
+static mrb_value
+ui_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_value display;
+  mrb_get_args(mrb, "o", &display);
+  spi_config_t *spicfg = display_open(mrb, (spi_config_t *)mrb_data_get_ptr(mrb, display, &mrb_spi_config_type));
+
+  ui_t *ui = (ui_t *)DATA_PTR(self);
+  if (ui) {
+    ui_free(mrb, ui);
+  }
+  ui = (ui_t *)mrb_malloc(mrb, sizeof(ui_t));
+  ui->spicfg = spicfg;
+  ui->generation = spicfg->generation;
+  ui->width = spicfg->tinygrafx.display_width;
+  ui->height = spicfg->tinygrafx.display_height;
+  widget_tree_init(&ui->tree);
+  DATA_TYPE(self) = &mrb_ui_type;
+  DATA_PTR(self)  = ui;
+  // keep the display alive while the UI is used
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "@display"), display);
+  return self;
+}
+
+// Add a widget, returns the widget id
+static mrb_value
+ui_add(mrb_state *mrb, mrb_value self)
+{
+  mrb_int type, parent, x, y, w, h;
+  ui_t *ui = (ui_t *)DATA_PTR(self);
+  mrb_get_args(mrb, "iiiiii", &type, &parent, &x, &y, &w, &h);
+  if ((type < WIDGET_PANEL) || (type > WIDGET_ICON)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "unknown widget type");
+  }
+
+  int16_t id = widget_add(&ui->tree, type, parent, x, y, w, h);
+  if (id < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "cannot add the widget");
+  }
+  return mrb_fixnum_value(id);
+}
+
+// Set the value (Integer) or the text (String) of a widget
+static mrb_value
+ui_set(mrb_state *mrb, mrb_value self)
+{
+  mrb_int id;
+  mrb_value value;
+  bool ok;
+  ui_t *ui = (ui_t *)DATA_PTR(self);
+  mrb_get_args(mrb, "io", &id, &value);
+
+  if (mrb_string_p(value)) {
+    ok = widget_set_text(&ui->tree, id, RSTRING_PTR(value), RSTRING_LEN(value));
+  } else {
+    ok = widget_set_value(&ui->tree, id, mrb_fixnum(mrb_Integer(mrb, value)));
+  }
+  if (!ok) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "unknown widget id");
+  }
+  return value;
+}
+
+// Set the range of a bar or a gauge
+static mrb_value
+ui_range(mrb_state *mrb, mrb_value self)
+{
+  mrb_int id, min, max;
+  ui_t *ui = (ui_t *)DATA_PTR(self);
+  mrb_get_args(mrb, "iii", &id, &min, &max);
+
+  if (!widget_set_range(&ui->tree, id, min, max)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "unknown widget id");
+  }
+  return self;
+}
+
+// Set the bitmap of an icon, w * ((h + 7) / 8) bytes in the frame buffer layout
+static mrb_value
+ui_bitmap(mrb_state *mrb, mrb_value self)
+{
+  mrb_int id;
+  mrb_value data;
+  ui_t *ui = (ui_t *)DATA_PTR(self);
+  mrb_get_args(mrb, "iS", &id, &data);
+  if ((id < 0) || (id >= ui->tree.count)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "unknown widget id");
+  }
+
+  widget_t *wg = &ui->tree.widgets[id];
+  if (RSTRING_LEN(data) < wg->w * ((wg->h + 7) / 8)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "bitmap is too short");
+  }
+  if (!widget_set_bitmap(&ui->tree, id, (const uint8_t *)RSTRING_PTR(data), RSTRING_LEN(data))) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the bitmap");
+  }
+  return self;
+}
+
+// Redraw all widgets on the next render
+static mrb_value
+ui_invalidate(mrb_state *mrb, mrb_value self)
+{
+  ui_t *ui = (ui_t *)DATA_PTR(self);
+  widget_invalidate(&ui->tree);
+  return self;
+}
+
+// Redraw the dirty widgets and send the damaged area.
+// Returns the number of data bytes sent.
+static mrb_value
+ui_render(mrb_state *mrb, mrb_value self)
+{
+  ui_t *ui = (ui_t *)DATA_PTR(self);
+  spi_config_t *spicfg = display_open(mrb, ui->spicfg);
+  tinygrafx_rect_t damage[WIDGET_MAX_DAMAGE];
+
+  // the frame buffer is new, or in another layout
+  if ((ui->generation != spicfg->generation) || (ui->width != spicfg->tinygrafx.display_width) ||
+      (ui->height != spicfg->tinygrafx.display_height)) {
+    widget_invalidate(&ui->tree);
+    ui->generation = spicfg->generation;
+    ui->width = spicfg->tinygrafx.display_width;
+    ui->height = spicfg->tinygrafx.display_height;
+  }
+
+  uint8_t count = widget_render(&ui->tree, spicfg->tinygrafx, damage);
+  if (count == 0) {
+    return mrb_fixnum_value(0);
+  }
+  uint32_t sent = ssd1306_push_frame(mrb, spicfg, damage, count);
+  return mrb_fixnum_value(sent);
+}
+// ----- Retained widgets -----
+
+// ----- Strip chart -----
+
+// Chart Object
+typedef struct chart_obj_t {
+  spi_config_t *spicfg;     // Display of the chart
+  uint32_t generation;      // Generation of the display drawn
+  uint16_t width, height;   // Drawing area drawn
+  chart_t chart;            // Ring buffers of the series
+} chart_obj_t;
+
+static void
+chart_obj_free(mrb_state *mrb, void *ptr)
+{
+  chart_obj_t *chart = ptr;
+  chart_free(&chart->chart);
+  mrb_free(mrb, chart);
+}
+
+static const struct mrb_data_type mrb_chart_type = {
+  "chart_type", chart_obj_free
+};
+
+// The display of the chart, raise if the plot area is out of it.
+// The plot area is drawn again on a new or swapped frame buffer.
+static spi_config_t *
+chart_display(mrb_state *mrb, chart_obj_t *chart)
+{
+  spi_config_t *spicfg = display_open(mrb, chart->spicfg);
+  if (!chart_fits(&chart->chart, spicfg->tinygrafx)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "chart is out of the display");
+  }
+  if ((chart->generation != spicfg->generation) || (chart->width != spicfg->tinygrafx.display_width) ||
+      (chart->height != spicfg->tinygrafx.display_height)) {
+    chart_redraw(&chart->chart, spicfg->tinygrafx);
+    chart->generation = spicfg->generation;
+    chart->width = spicfg->tinygrafx.display_width;
+    chart->height = spicfg->tinygrafx.display_height;
+  }
+  return spicfg;
+}
+
+// OLED::Chart.new(oled, x, y, w, h, options)
+static mrb_value
+chart_obj_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_value display;
+  mrb_int x, y, w, h, series, mode;
+  mrb_get_args(mrb, "oiiiiii", &display, &x, &y, &w, &h, &series, &mode);
+  spi_config_t *spicfg = display_open(mrb, (spi_config_t *)mrb_data_get_ptr(mrb, display, &mrb_spi_config_type));
+  tinygrafx_rect_t area = { x, y, w, h };
+  tinygrafx_rect_t clipped = area;
+
+  if (!rect_clip(spicfg->tinygrafx, &clipped) || (clipped.w != w) || (clipped.h != h) || (w < 2) || (h < 2)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "chart must be in the display, 2x2 pixel or larger");
+  }
+  if ((series < 1) || (series > CHART_MAX_SERIES)) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "series must be 1..%S", mrb_fixnum_value(CHART_MAX_SERIES));
+  }
+  if ((mode != CHART_SCROLL) && (mode != CHART_SWEEP)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "unknown chart mode");
+  }
+
+  chart_obj_t *chart = (chart_obj_t *)DATA_PTR(self);
+  if (chart) {
+    chart_obj_free(mrb, chart);
+  }
+  DATA_PTR(self) = NULL;
+  chart = (chart_obj_t *)mrb_malloc(mrb, sizeof(chart_obj_t));
+  if (!chart_init(&chart->chart, area, series, mode)) {
+    chart_free(&chart->chart);
+    mrb_free(mrb, chart);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the chart");
+  }
+  chart->spicfg = spicfg;
+  chart->generation = spicfg->generation;
+  chart->width = spicfg->tinygrafx.display_width;
+  chart->height = spicfg->tinygrafx.display_height;
+  DATA_TYPE(self) = &mrb_chart_type;
+  DATA_PTR(self)  = chart;
+  // keep the display alive while the chart is used
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "@display"), display);
+  chart_clear(&chart->chart, spicfg->tinygrafx);
+  return self;
+}
+
+// Append a sample of each series, drawn in the frame buffer and shown by flush
+static mrb_value
+chart_obj_push(mrb_state *mrb, mrb_value self)
+{
+  mrb_value values;
+  chart_obj_t *chart = (chart_obj_t *)DATA_PTR(self);
+  mrb_get_args(mrb, "A", &values);
+  spi_config_t *spicfg = chart_display(mrb, chart);
+  int32_t samples[CHART_MAX_SERIES];
+
+  if (RARRAY_LEN(values) != chart->chart.series) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "give %S samples", mrb_fixnum_value(chart->chart.series));
+  }
+  for (uint8_t s = 0; s < chart->chart.series; s++) {
+    samples[s] = mrb_fixnum(mrb_to_int(mrb, mrb_ary_ref(mrb, values, s)));
+  }
+  chart_push(&chart->chart, spicfg->tinygrafx, samples);
+  return self;
+}
+
+// Send the area changed by the samples to the display.
+// Returns the number of data bytes sent.
+static mrb_value
+chart_obj_flush(mrb_state *mrb, mrb_value self)
+{
+  chart_obj_t *chart = (chart_obj_t *)DATA_PTR(self);
+  spi_config_t *spicfg = chart_display(mrb, chart);
+  tinygrafx_rect_t damage;
+
+  if (!chart_take_damage(&chart->chart, &damage)) {
+    return mrb_fixnum_value(0);
+  }
+  uint32_t sent = ssd1306_push_frame(mrb, spicfg, &damage, 1);
+  return mrb_fixnum_value(sent);
+}
+
+static mrb_value
+chart_obj_clear(mrb_state *mrb, mrb_value self)
+{
+  chart_obj_t *chart = (chart_obj_t *)DATA_PTR(self);
+  chart_clear(&chart->chart, chart_display(mrb, chart)->tinygrafx);
+  return self;
+}
+
+// Fixed value range of the plot area, drawn again by the next push
+static mrb_value
+chart_obj_range(mrb_state *mrb, mrb_value self)
+{
+  mrb_int min, max;
+  chart_obj_t *chart = (chart_obj_t *)DATA_PTR(self);
+  mrb_get_args(mrb, "ii", &min, &max);
+  if (min >= max) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "min must be less than max");
+  }
+
+  chart_set_range(&chart->chart, min, max);
+  return self;
+}
+
+static mrb_value
+chart_obj_autoscale(mrb_state *mrb, mrb_value self)
+{
+  chart_obj_t *chart = (chart_obj_t *)DATA_PTR(self);
+  chart_set_autoscale(&chart->chart);
+  return self;
+}
+
+// Current value range, [min, max]
+static mrb_value
+chart_obj_get_range(mrb_state *mrb, mrb_value self)
+{
+  chart_obj_t *chart = (chart_obj_t *)DATA_PTR(self);
+  mrb_value range = mrb_ary_new_capa(mrb, 2);
+  mrb_ary_push(mrb, range, mrb_fixnum_value(chart->chart.min));
+  mrb_ary_push(mrb, range, mrb_fixnum_value(chart->chart.max));
+  return range;
+}
+// ----- Strip chart -----
+
+// ----- Virtual surface -----
+// The surface is drawn once, and the region of each panel is copied to
+// the frame buffer of its display on display. The panels are sent one
+// after another, the next panel is sliced and diffed while the data of
+// the previous one is still in flight.
+
+// Transfer of a panel, started and finished by the pipeline
+typedef struct surface_job_t {
+  spi_config_t *spicfg;     // Display of the panel
+  const uint8_t *buffer;    // Panel buffer in flight
+  uint32_t hashes[FRAME_HASH_PAGES];
+  tinygrafx_rect_t rects[FRAME_HASH_PAGES];
+  uint8_t count;            // Number of the changed rectangles
+  uint8_t pending;          // Control commands of the frame, sent again by a retry
+  uint32_t sent;            // Data bytes sent
+  xfer_err_t err;           // Result of the start
+} surface_job_t;
+
+// OLED::Surface.new(width, height)
+static mrb_value
+surface_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_int width, height;
+  mrb_get_args(mrb, "ii", &width, &height);
+
+#ifdef TG_FIXED_GEOMETRY
+  mrb_raise(mrb, E_NOTIMP_ERROR, "surface is not available in the fixed geometry build");
+#endif
+  if ((width < 1) || (width > SURFACE_MAX_WIDTH) || (height < 8) || (height > SURFACE_MAX_HEIGHT) || ((height % 8) != 0)) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "surface must be up to %Sx%S, the height in a multiple of 8",
+               mrb_fixnum_value(SURFACE_MAX_WIDTH), mrb_fixnum_value(SURFACE_MAX_HEIGHT));
+  }
+
+  surface_t *surface = (surface_t *)DATA_PTR(self);
+  if (surface) {
+    surface_free(mrb, surface);
+  }
+  DATA_PTR(self) = NULL;
+  surface = (surface_t *)mrb_malloc(mrb, sizeof(surface_t));
+  memset(surface, 0, sizeof(surface_t));
+  tinygrafx_t tg = {
+    .display_width = width,
+    .display_height = height,
+    .display_pages = height / 8,
+    .display_pixel = (uint32_t)width * (height / 8),
+    .font_width = SSD1306_FONT_WIDTH,
+    .font_height = SSD1306_FONT_HEIGHT
+  };
+  tg.display_buffer = (uint8_t *)calloc(1, tg.display_pixel);
+  if (tg.display_buffer == NULL) {
+    mrb_free(mrb, surface);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot allocate the surface");
+  }
+  surface->tinygrafx = tg;
+  DATA_TYPE(self) = &mrb_surface_type;
+  DATA_PTR(self)  = surface;
+  return self;
+}
+
+// The region of the panel is in the surface
+static bool
+surface_fits(const surface_t *surface, const surface_panel_t *panel)
+{
+  const tinygrafx_t *tg = &panel->spicfg->tinygrafx;
+  return (panel->x >= 0) && (panel->y >= 0) && ((panel->y % 8) == 0) &&
+         (panel->x + tg->display_width <= surface->tinygrafx.display_width) &&
+         (panel->y + tg->display_height <= surface->tinygrafx.display_height);
+}
+
+// Show the region at (x, y) of the surface on the display.
+// The same region may be attached to several displays as the mirrors.
+static mrb_value
+surface_attach(mrb_state *mrb, mrb_value self)
+{
+  mrb_value display;
+  mrb_int x, y;
+  surface_t *surface = (surface_t *)mrb_data_get_ptr(mrb, self, &mrb_surface_type);
+  mrb_get_args(mrb, "oii", &display, &x, &y);
+  spi_config_t *spicfg = display_open(mrb, (spi_config_t *)mrb_data_get_ptr(mrb, display, &mrb_spi_config_type));
+  surface_panel_t panel = { spicfg, x, y };
+
+  if (!surface_fits(surface, &panel)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "panel must be in the surface, y in a multiple of 8");
+  }
+  for (uint8_t i = 0; i < surface->count; i++) {
+    if (surface->panels[i].spicfg == spicfg) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "display is already attached");
+    }
+  }
+  if (surface->count >= SURFACE_MAX_PANELS) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "surface has up to %S panels", mrb_fixnum_value(SURFACE_MAX_PANELS));
+  }
+  surface->panels[surface->count++] = panel;
+  return self;
+}
+
+// Copy the region of the panel to its frame buffer, page by page
+static void
+surface_slice(const surface_t *surface, const surface_panel_t *panel)
+{
+  const tinygrafx_t *src = &surface->tinygrafx;
+  const tinygrafx_t *dst = &panel->spicfg->tinygrafx;
+
+  for (int16_t page = 0; page < dst->display_pages; page++) {
+    memcpy(dst->display_buffer + page * dst->display_width,
+           src->display_buffer + (panel->y / 8 + page) * src->display_width + panel->x,
+           dst->display_width);
+  }
+}
+
+// Start sending the changed pages of the panel, the bus is locked until
+// surface_job_finish(). The data may be still in flight on return.
+static void
+surface_job_start(surface_job_t *job)
+{
+  spi_config_t *spicfg = job->spicfg;
+
+  xSemaphoreTake(spicfg->bus_lock, portMAX_DELAY);
+  job->buffer = ssd1306_frame_prepare(spicfg, spicfg->tinygrafx.display_buffer);
+  job->pending = spicfg->panel.pending;
+  job->sent = 0;
+  job->err = ssd1306_frame_start(&spicfg->panel, job->buffer, job->rects, job->count, &job->sent);
+}
+
+// Wait for the panel, and send it again up to the retries if failed,
+// as ssd1306_send_frame() does, unlocked in the delays.
+// Returns the result of the panel.
+static xfer_err_t
+surface_job_finish(surface_job_t *job)
+{
+  spi_config_t *spicfg = job->spicfg;
+  xfer_err_t err = ssd1306_frame_finish(&spicfg->panel, job->err);
+
+  for (uint8_t retry = 0; (err != XFER_OK) && (retry < spicfg->retries); retry++) {
+    spicfg->panel.pending |= job->pending;
+    spicfg->xfer.retries++;
+    xSemaphoreGive(spicfg->bus_lock);
+    vTaskDelay(((uint32_t)spicfg->backoff_ms << retry) / portTICK_PERIOD_MS);
+    xSemaphoreTake(spicfg->bus_lock, portMAX_DELAY);
+    job->buffer = ssd1306_frame_rotate(spicfg, spicfg->tinygrafx.display_buffer);
+    job->sent = 0;
+    err = ssd1306_write_frame(&spicfg->panel, job->buffer, job->rects, job->count, &job->sent);
+  }
+  if (err == XFER_OK) {
+    spicfg->xfer.frames++;
+  } else {
+    spicfg->panel.pending |= job->pending;
+    spicfg->xfer.failed++;
+  }
+  xSemaphoreGive(spicfg->bus_lock);
+
+  if (err != XFER_OK) {
+    spicfg->page_valid = 0;
+    return err;
+  }
+  frame_hash_commit(spicfg, job->hashes);
+  spicfg->xfer.skipped_bytes += spicfg->tinygrafx.display_pixel - job->sent;
+  return XFER_OK;
+}
+
+// display the surface on the panels, only the pages changed on each panel.
+// All pages are sent if force. Raise OLED::TransferError of the first
+// failed panel after all panels are tried.
+// Returns the number of data bytes sent.
+static mrb_value
+surface_display(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool force;
+  surface_t *surface = (surface_t *)mrb_data_get_ptr(mrb, self, &mrb_surface_type);
+  mrb_get_args(mrb, "b", &force);
+  surface_job_t jobs[2];
+  surface_job_t *prev = NULL;
+  spi_config_t *failed = NULL;
+  xfer_err_t err, first_err = XFER_OK;
+  uint32_t total = 0, sent;
+
+  // raise before any panel is sent
+  for (uint8_t i = 0; i < surface->count; i++) {
+    display_open(mrb, surface->panels[i].spicfg);
+    if (!surface_fits(surface, &surface->panels[i])) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "panel is out of the surface");
+    }
+  }
+
+  for (uint8_t i = 0; i < surface->count; i++) {
+    surface_job_t *job = &jobs[i % 2];
+    job->spicfg = surface->panels[i].spicfg;
+    // sliced and diffed while the previous panel is in flight
+    surface_slice(surface, &surface->panels[i]);
+    if (force) {
+      job->spicfg->page_valid = 0;
+    }
+    job->count = frame_diff(job->spicfg, job->hashes, job->rects);
+
+    // the panels may share the bus, one panel is selected at a time
+    if (prev != NULL) {
+      err = surface_job_finish(prev);
+      total += prev->sent;
+      if ((err != XFER_OK) && (failed == NULL)) {
+        failed = prev->spicfg;
+        first_err = err;
+      }
+      prev = NULL;
+    }
+    if (job->count == 0) {
+      err = ssd1306_send_diff(job->spicfg, job->hashes, job->rects, 0, &sent);
+      if ((err != XFER_OK) && (failed == NULL)) {
+        failed = job->spicfg;
+        first_err = err;
+      }
+      continue;
+    }
+    surface_job_start(job);
+    prev = job;
+  }
+  if (prev != NULL) {
+    err = surface_job_finish(prev);
+    total += prev->sent;
+    if ((err != XFER_OK) && (failed == NULL)) {
+      failed = prev->spicfg;
+      first_err = err;
+    }
+  }
+
+  if (failed != NULL) {
+    raise_xfer_error(mrb, failed, first_err);
+  }
+  return mrb_fixnum_value(total);
+}
+
+// Number of the panels attached
+static mrb_value
+surface_panels(mrb_state *mrb, mrb_value self)
+{
+  surface_t *surface = (surface_t *)mrb_data_get_ptr(mrb, self, &mrb_surface_type);
+  return mrb_fixnum_value(surface->count);
+}
+// ----- Virtual surface -----
+
+// ----- Mock display -----
+
+static oled_mock_t *
+get_mock(mrb_state *mrb, mrb_value self)
+{
+  spi_config_t *spicfg = get_spicfg(mrb, self);
+  if (spicfg->panel.bus->type != OLED_BUS_MOCK) {
+    mrb_raise(mrb, E_TYPE_ERROR, "not a mock display");
+  }
+  return (oled_mock_t *)spicfg->panel.bus;
+}
+
+// Traffic log as a String, records of
+//   kind ('C' commands, 'D' data, 'R' reset), length (u16), bytes
+static mrb_value
+mock_traffic(mrb_state *mrb, mrb_value self)
+{
+  oled_mock_t *mock = get_mock(mrb, self);
+  return mrb_str_new(mrb, (const char *)mock->log, mock->log_used);
+}
+
+static mrb_value
+mock_traffic_stats(mrb_state *mrb, mrb_value self)
+{
+  oled_mock_t *mock = get_mock(mrb, self);
+
+  mrb_value stats = mrb_hash_new(mrb);
+  HASH_SET_INT(stats, "transactions", mock->transactions);
+  HASH_SET_INT(stats, "cmd_bytes", mock->cmd_bytes);
+  HASH_SET_INT(stats, "data_bytes", mock->data_bytes);
+  HASH_SET_INT(stats, "frames", mock->frames);
+  HASH_SET_INT(stats, "resets", mock->resets);
+  HASH_SET_INT(stats, "dropped", mock->log_dropped);
+  HASH_SET_INT(stats, "time_us", mock->sim_time_ns / 1000);
+  return stats;
+}
+
+static mrb_value
+mock_traffic_clear(mrb_state *mrb, mrb_value self)
+{
+  oled_mock_clear(get_mock(mrb, self));
+  return self;
+}
+// ----- Mock display -----
+
+void
+mrb_mruby_esp32_spi_ssd1306_gem_init(mrb_state* mrb)
+{
+  struct RClass *oled = mrb_define_module(mrb, "OLED");
+  mrb_define_class_under(mrb, oled, "TransferError", E_RUNTIME_ERROR);
+  mrb_define_const(mrb, oled, "BLACK", mrb_fixnum_value(BLACK));
+  mrb_define_const(mrb, oled, "WHITE", mrb_fixnum_value(WHITE));
+  mrb_define_const(mrb, oled, "INVERT", mrb_fixnum_value(INVERT));
+
+  // Dithering methods
+  mrb_define_const(mrb, oled, "THRESHOLD", mrb_fixnum_value(DITHER_THRESHOLD));
+  mrb_define_const(mrb, oled, "BAYER", mrb_fixnum_value(DITHER_BAYER));
+  mrb_define_const(mrb, oled, "FLOYD_STEINBERG", mrb_fixnum_value(DITHER_FLOYD_STEINBERG));
+  mrb_define_const(mrb, oled, "ATKINSON", mrb_fixnum_value(DITHER_ATKINSON));
+
+  // Display of any bus, the controller logic and the frame buffer
+  struct RClass *ssd1306 = mrb_define_class_under(mrb, oled, "SSD1306", mrb->object_class);
+  MRB_SET_INSTANCE_TT(ssd1306, MRB_TT_DATA);
+
+  // Common graphics methods
+  mrb_define_method(mrb, ssd1306, "clear", lcd_clear, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "set_pixel", lcd_set_pixel, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, ssd1306, "get_pixel", lcd_get_pixel, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, ssd1306, "line", lcd_draw_line, MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, ssd1306, "vline", lcd_draw_vertical_line, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, ssd1306, "hline", lcd_draw_horizontal_line, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, ssd1306, "rect", lcd_draw_rect, MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, ssd1306, "fill_rect", lcd_draw_fill_rect, MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, ssd1306, "circle", lcd_draw_circle, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, ssd1306, "fill_circle", lcd_draw_fill_circle, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, ssd1306, "text", lcd_text, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, ssd1306, "image", lcd_image, MRB_ARGS_ARG(5, 1));
+
+  // Temporal grayscale
+  mrb_define_method(mrb, ssd1306, "gray_start", ssd1306_gray_start, MRB_ARGS_ARG(1, 2));
+  mrb_define_method(mrb, ssd1306, "gray_stop", ssd1306_gray_stop, MRB_ARGS_NONE());
+
+  // Send frame buffer to display
+  mrb_define_method(mrb, ssd1306, "_display", ssd1306_spi_display, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "display_rect", ssd1306_spi_display_rect, MRB_ARGS_REQ(4));
+
+  // Control commands
+  mrb_define_method(mrb, ssd1306, "contrast=", ssd1306_set_contrast, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "contrast", ssd1306_get_contrast, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "invert=", ssd1306_set_invert, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "power=", ssd1306_set_power, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "flip", ssd1306_flip, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, ssd1306, "flush", ssd1306_flush, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "rotation=", ssd1306_set_rotation, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "rotation", ssd1306_get_rotation, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "width", ssd1306_get_width, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "height", ssd1306_get_height, MRB_ARGS_NONE());
+
+  // Transfer errors
+  mrb_define_method(mrb, ssd1306, "timeout=", ssd1306_set_timeout, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "set_retry", ssd1306_set_retry, MRB_ARGS_ARG(1, 1));
+  mrb_define_method(mrb, ssd1306, "transfer_stats", ssd1306_transfer_stats, MRB_ARGS_NONE());
+
+  // Bus clock and transfer model
+  mrb_define_method(mrb, ssd1306, "freq=", ssd1306_set_freq, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "freq", ssd1306_get_freq, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "transaction_overhead=", ssd1306_set_transaction_overhead, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "frame_time_estimate", ssd1306_frame_time_estimate, MRB_ARGS_OPT(4));
+
+  // Frame scheduler
+  mrb_define_method(mrb, ssd1306, "frame_rate=", ssd1306_set_frame_rate, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ssd1306, "begin_frame", ssd1306_begin_frame, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "end_frame", ssd1306_end_frame, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, ssd1306, "frame_stats", ssd1306_frame_stats, MRB_ARGS_NONE());
+
+  // Memory usage
+  mrb_define_method(mrb, ssd1306, "memory_usage", ssd1306_memory_usage, MRB_ARGS_NONE());
+
+  // Frame recorder
+  mrb_define_method(mrb, ssd1306, "record_start", ssd1306_record_start, MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, ssd1306, "record_stop", ssd1306_record_stop, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "recording", ssd1306_recording, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "record_stats", ssd1306_record_stats, MRB_ARGS_NONE());
+
+  // ssd1306 method
+  mrb_define_method(mrb, ssd1306, "close", ssd1306_spi_close, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ssd1306, "closed?", ssd1306_spi_closed, MRB_ARGS_NONE());
   // mrb_define_method(mrb, ssd1306, "initialize_copy", spi_init_copy, MRB_ARGS_REQ(1));
   mrb_define_method(mrb, ssd1306, "config?", spi_view_config, MRB_ARGS_NONE());
 
@@ -575,6 +2399,93 @@ mrb_mruby_esp32_spi_ssd1306_gem_init(mrb_state* mrb)
   mrb_define_const(mrb, constants, "NO_DMA",    mrb_fixnum_value(NO_DMA));
   mrb_define_const(mrb, constants, "DMA_CH1",   mrb_fixnum_value(DMA_CH1));
   mrb_define_const(mrb, constants, "DMA_CH2",   mrb_fixnum_value(DMA_CH2));
+  mrb_define_const(mrb, constants, "WIDTH",     mrb_fixnum_value(SSD1306_DISPLAY_WIDTH));
+  mrb_define_const(mrb, constants, "HEIGHT",    mrb_fixnum_value(SSD1306_DISPLAY_HEIGHT));
+  mrb_define_const(mrb, constants, "SSD1306",   mrb_fixnum_value(CTRL_SSD1306));
+  mrb_define_const(mrb, constants, "SH1106",    mrb_fixnum_value(CTRL_SH1106));
+  mrb_define_const(mrb, constants, "COL_OFFSET_AUTO", mrb_fixnum_value(COL_OFFSET_AUTO));
+  mrb_define_const(mrb, constants, "I2C_PORT",  mrb_fixnum_value(SSD1306I2C_PORT));
+  mrb_define_const(mrb, constants, "SDA",       mrb_fixnum_value(SSD1306I2C_PIN_NUM_SDA));
+  mrb_define_const(mrb, constants, "SCL",       mrb_fixnum_value(SSD1306I2C_PIN_NUM_SCL));
+  mrb_define_const(mrb, constants, "I2C_ADDR",  mrb_fixnum_value(SSD1306I2C_ADDR));
+  mrb_define_const(mrb, constants, "I2C_FREQ",  mrb_fixnum_value(SSD1306I2C_CLOCK_SPEED_HZ));
+  mrb_define_const(mrb, constants, "MOCK_OVERHEAD_NS", mrb_fixnum_value(MOCK_OVERHEAD_NS));
+  mrb_define_const(mrb, constants, "MOCK_LOG_SIZE", mrb_fixnum_value(MOCK_LOG_SIZE));
+  mrb_define_const(mrb, constants, "BUS_SPI",   mrb_fixnum_value(OLED_BUS_SPI));
+  mrb_define_const(mrb, constants, "BUS_I2C",   mrb_fixnum_value(OLED_BUS_I2C));
+
+  // SSD1306 on SPI, on I2C, and the mock recording the traffic
+  struct RClass *spi = mrb_define_class_under(mrb, oled, "SSD1306SPI", ssd1306);
+  mrb_define_method(mrb, spi, "_init", ssd1306_spi_init, MRB_ARGS_NONE());
+  struct RClass *i2c = mrb_define_class_under(mrb, oled, "SSD1306I2C", ssd1306);
+  mrb_define_method(mrb, i2c, "_init_i2c", ssd1306_i2c_init, MRB_ARGS_REQ(10));
+  struct RClass *mock = mrb_define_class_under(mrb, oled, "SSD1306Mock", ssd1306);
+  mrb_define_method(mrb, mock, "_init_mock", ssd1306_mock_init, MRB_ARGS_REQ(8));
+  mrb_define_method(mrb, mock, "traffic", mock_traffic, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mock, "traffic_stats", mock_traffic_stats, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mock, "traffic_clear", mock_traffic_clear, MRB_ARGS_NONE());
+
+  // Text console
+  struct RClass *console = mrb_define_class_under(mrb, oled, "Console", mrb->object_class);
+  MRB_SET_INSTANCE_TT(console, MRB_TT_DATA);
+  mrb_define_method(mrb, console, "initialize", console_obj_init, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, console, "write", console_obj_write, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, console, "flush", console_obj_flush, MRB_ARGS_NONE());
+  mrb_define_method(mrb, console, "clear", console_obj_clear, MRB_ARGS_NONE());
+  mrb_define_method(mrb, console, "size", console_obj_size, MRB_ARGS_NONE());
+
+  // Strip chart
+  struct RClass *chart = mrb_define_class_under(mrb, oled, "Chart", mrb->object_class);
+  MRB_SET_INSTANCE_TT(chart, MRB_TT_DATA);
+  mrb_define_method(mrb, chart, "_init", chart_obj_init, MRB_ARGS_REQ(7));
+  mrb_define_method(mrb, chart, "_push", chart_obj_push, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, chart, "flush", chart_obj_flush, MRB_ARGS_NONE());
+  mrb_define_method(mrb, chart, "clear", chart_obj_clear, MRB_ARGS_NONE());
+  mrb_define_method(mrb, chart, "range", chart_obj_range, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, chart, "autoscale", chart_obj_autoscale, MRB_ARGS_NONE());
+  mrb_define_method(mrb, chart, "current_range", chart_obj_get_range, MRB_ARGS_NONE());
+  mrb_define_const(mrb, chart, "SCROLL", mrb_fixnum_value(CHART_SCROLL));
+  mrb_define_const(mrb, chart, "SWEEP", mrb_fixnum_value(CHART_SWEEP));
+
+  // Virtual surface
+  struct RClass *surface = mrb_define_class_under(mrb, oled, "Surface", mrb->object_class);
+  MRB_SET_INSTANCE_TT(surface, MRB_TT_DATA);
+  mrb_define_method(mrb, surface, "_init", surface_init, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, surface, "_attach", surface_attach, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, surface, "_display", surface_display, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, surface, "panels", surface_panels, MRB_ARGS_NONE());
+  mrb_define_method(mrb, surface, "width", ssd1306_get_width, MRB_ARGS_NONE());
+  mrb_define_method(mrb, surface, "height", ssd1306_get_height, MRB_ARGS_NONE());
+  mrb_define_method(mrb, surface, "clear", lcd_clear, MRB_ARGS_NONE());
+  mrb_define_method(mrb, surface, "set_pixel", lcd_set_pixel, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, surface, "get_pixel", lcd_get_pixel, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, surface, "line", lcd_draw_line, MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, surface, "vline", lcd_draw_vertical_line, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, surface, "hline", lcd_draw_horizontal_line, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, surface, "rect", lcd_draw_rect, MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, surface, "fill_rect", lcd_draw_fill_rect, MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, surface, "circle", lcd_draw_circle, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, surface, "fill_circle", lcd_draw_fill_circle, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, surface, "text", lcd_text, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, surface, "image", lcd_image, MRB_ARGS_ARG(5, 1));
+
+  // Retained widgets
+  struct RClass *ui = mrb_define_class_under(mrb, oled, "UI", mrb->object_class);
+  MRB_SET_INSTANCE_TT(ui, MRB_TT_DATA);
+  mrb_define_method(mrb, ui, "initialize", ui_init, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, ui, "_add", ui_add, MRB_ARGS_REQ(6));
+  mrb_define_method(mrb, ui, "set", ui_set, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, ui, "range", ui_range, MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, ui, "bitmap", ui_bitmap, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, ui, "invalidate", ui_invalidate, MRB_ARGS_NONE());
+  mrb_define_method(mrb, ui, "render", ui_render, MRB_ARGS_NONE());
+  mrb_define_const(mrb, ui, "PANEL",  mrb_fixnum_value(WIDGET_PANEL));
+  mrb_define_const(mrb, ui, "LABEL",  mrb_fixnum_value(WIDGET_LABEL));
+  mrb_define_const(mrb, ui, "NUMBER", mrb_fixnum_value(WIDGET_NUMBER));
+  mrb_define_const(mrb, ui, "BAR",    mrb_fixnum_value(WIDGET_BAR));
+  mrb_define_const(mrb, ui, "GAUGE",  mrb_fixnum_value(WIDGET_GAUGE));
+  mrb_define_const(mrb, ui, "ICON",   mrb_fixnum_value(WIDGET_ICON));
+  mrb_define_const(mrb, ui, "NO_PARENT", mrb_fixnum_value(WIDGET_NO_PARENT));
 }
 
 void
@@ -0,0 +1,352 @@
+// ===================================================================
+//
+//    SSD1306 / SH1106 controller logic
+//
+// ===================================================================
+//
+// Builds the command sequences of the controller and writes the frame
+// buffer in the page layout, through the transport of oled_transport.h.
+// The panel buffer is width x pages bytes, the drawing area is rotated
+// by 90 or 270 degree from the panel.
+//
+// ===================================================================
+
+#include <string.h>
+
+#include "ssd1306.h"
+
+// Column RAM width of the controller
+uint8_t
+ssd1306_ram_width(uint8_t controller)
+{
+  return (controller == CTRL_SH1106) ? SH1106_RAM_WIDTH : SSD1306_RAM_WIDTH;
+}
+
+// 180 degree rotation is done by the display, mirroring both directions.
+static bool
+mirror_h(const ssd1306_t *panel)
+{
+  return panel->flip_h ^ (panel->rotation == 180);
+}
+
+static bool
+mirror_v(const ssd1306_t *panel)
+{
+  return panel->flip_v ^ (panel->rotation == 180);
+}
+
+// First column of the panel in the controller RAM.
+// The segment re-map mirrors the column RAM, so the offset is mirrored too.
+static uint8_t
+first_column(const ssd1306_t *panel)
+{
+  if (mirror_h(panel)) {
+    return ssd1306_ram_width(panel->controller) - panel->col_offset - panel->width;
+  }
+  return panel->col_offset;
+}
+
+// Build the pending control commands, and clear the pending flags.
+// Returns the length of the command bytes.
+static uint8_t
+ssd1306_pending_cmds(ssd1306_t *panel, uint8_t *cmds)
+{
+  uint8_t n = 0;
+
+  if (panel->pending & PENDING_CONTRAST) {
+    cmds[n++] = 0x81;                                   // set contrast
+    cmds[n++] = panel->contrast;
+  }
+  if (panel->pending & PENDING_INVERT) {
+    cmds[n++] = panel->inverted ? 0xA7 : 0xA6;          // inverse / normal display
+  }
+  if (panel->pending & PENDING_FLIP) {
+    cmds[n++] = mirror_h(panel) ? 0xA0 : 0xA1;          // segment re-map
+    cmds[n++] = mirror_v(panel) ? 0xC0 : 0xC8;          // COM scan direction
+  }
+  if (panel->pending & PENDING_POWER) {
+    cmds[n++] = panel->power ? 0xAF : 0xAE;             // display ON / OFF
+  }
+  panel->pending = 0;
+  return n;
+}
+
+// Build the init commands for the panel geometry.
+// Returns the length of the command sequence.
+uint16_t
+ssd1306_build_init_cmds(ssd1306_t *panel, uint8_t *cmds)
+{
+  uint16_t n = 0;
+
+  cmds[n++] = 0xAE;                     // display OFF
+  cmds[n++] = 0xA8;                     // MUX ratio (height - 1)
+  cmds[n++] = panel->height - 1;
+  cmds[n++] = 0xD3;                     // set display offset (no offset)
+  cmds[n++] = 0x00;
+  cmds[n++] = 0x40;                     // set display start line
+  cmds[n++] = mirror_h(panel) ? 0xA0 : 0xA1;   // re-map, SEG0 is mapped to the last column
+  cmds[n++] = mirror_v(panel) ? 0xC0 : 0xC8;   // scan direction, reverse up-bottom
+  cmds[n++] = 0xDA;                     // set COM pins
+  // panels taller than 32 rows use the alternative COM pin configuration
+  cmds[n++] = (panel->height > 32) ? 0x12 : 0x02;
+  cmds[n++] = 0x81;                     // set contrast
+  cmds[n++] = panel->contrast;
+  cmds[n++] = panel->inverted ? 0xA7 : 0xA6;   // normal / inverse display
+  cmds[n++] = 0xA4;                     // resume ram content display
+  cmds[n++] = 0xD5;                     // set osc frequency
+  cmds[n++] = 0x00;
+
+  if (panel->controller == CTRL_SH1106) {
+    cmds[n++] = 0xAD;                   // DC-DC control
+    cmds[n++] = 0x8B;                   // built-in DC-DC ON
+  } else {
+    cmds[n++] = 0x2E;                   // stop scrolling
+    cmds[n++] = 0x8D;                   // charge pump
+    cmds[n++] = 0x14;                   // enable charge pump
+    cmds[n++] = 0x20;                   // ADDR_MODE
+    cmds[n++] = 0x00;                   // 0x00 = Horizontal Mode
+  }
+
+  cmds[n++] = panel->power ? 0xAF : 0xAE;   // display ON
+  panel->pending = 0;
+  return n;
+}
+
+// Reset the display and send the init commands
+xfer_err_t
+ssd1306_init(ssd1306_t *panel)
+{
+  uint8_t cmds[INIT_CMDS_MAX_SIZE] __attribute__((aligned(4)));
+  uint16_t len = ssd1306_build_init_cmds(panel, cmds);
+  xfer_err_t err;
+
+  oled_reset(panel->bus);
+  oled_begin(panel->bus);
+  err = oled_send_cmds(panel->bus, cmds, len);
+  oled_end(panel->bus);
+  return err;
+}
+
+// Send the pending control commands without a frame.
+// The commands are kept pending if failed.
+xfer_err_t
+ssd1306_flush_cmds(ssd1306_t *panel)
+{
+  uint8_t cmds[PENDING_CMDS_MAX_SIZE];
+  uint8_t pending = panel->pending;
+  uint8_t n = ssd1306_pending_cmds(panel, cmds);
+  xfer_err_t err = XFER_OK;
+
+  if (n > 0) {
+    oled_begin(panel->bus);
+    err = oled_send_cmds(panel->bus, cmds, n);
+    oled_end(panel->bus);
+    if (err != XFER_OK) {
+      panel->pending |= pending;
+    }
+  }
+  return err;
+}
+
+// Write a rectangle of the panel buffer in the frame.
+// The pending control commands go with the address commands.
+// The number of data bytes is added to sent.
+static xfer_err_t
+ssd1306_write_rect(ssd1306_t *panel, const uint8_t *buffer, const tinygrafx_rect_t *r, uint32_t *sent)
+{
+  uint8_t cmds[PENDING_CMDS_MAX_SIZE + 6];
+  uint8_t n = ssd1306_pending_cmds(panel, cmds);
+  uint8_t col = first_column(panel) + r->x;
+  uint8_t page0 = r->y / 8;
+  uint8_t page1 = (r->y + r->h - 1) / 8;
+  oled_transport_t *bus = panel->bus;
+  xfer_err_t err;
+
+  if (panel->controller == CTRL_SH1106) {
+    // NOTE: SH1106 has no horizontal addressing mode, each page is addressed
+    // separately by the page address and the column address commands.
+    for (uint8_t page = page0; page <= page1; page++) {
+      cmds[n++] = 0xB0 | page;                          // PAGE_ADDR
+      cmds[n++] = 0x00 | (col & 0x0F);                  // lower COLUMN_ADDR
+      cmds[n++] = 0x10 | (col >> 4);                    // higher COLUMN_ADDR
+      if (((err = oled_send_cmds(bus, cmds, n)) != XFER_OK) ||
+          ((err = oled_send_data_async(bus, buffer + page * panel->width + r->x, r->w)) != XFER_OK)) {
+        return err;
+      }
+      *sent += r->w;
+      n = 0;
+    }
+    return XFER_OK;
+  }
+
+  cmds[n++] = 0x21;                                     // COLUMN_ADDR
+  cmds[n++] = col;                                      //   start
+  cmds[n++] = col + r->w - 1;                           //   end
+  cmds[n++] = 0x22;                                     // PAGE_ADDR
+  cmds[n++] = page0;                                    //   start
+  cmds[n++] = page1;                                    //   end
+  if ((err = oled_send_cmds(bus, cmds, n)) != XFER_OK) {
+    return err;
+  }
+
+  if (r->w == panel->width) {
+    // full width, the pages are contiguous in the buffer
+    uint32_t len = (uint32_t)r->w * (page1 - page0 + 1);
+    if ((err = oled_send_data_async(bus, buffer + page0 * panel->width, len)) != XFER_OK) {
+      return err;
+    }
+    *sent += len;
+  } else {
+    for (uint8_t page = page0; page <= page1; page++) {
+      if ((err = oled_send_data_async(bus, buffer + page * panel->width + r->x, r->w)) != XFER_OK) {
+        return err;
+      }
+      *sent += r->w;
+    }
+  }
+  return XFER_OK;
+}
+
+// Convert a rectangle of the drawing area to the panel
+static void
+rect_to_panel(const ssd1306_t *panel, tinygrafx_rect_t *r)
+{
+  tinygrafx_rect_t d = *r;
+
+  if (panel->rotation == 90) {
+    // panel (x, y) shows (y, width - 1 - x) of the drawing area
+    r->x = panel->width - d.y - d.h;
+    r->y = d.x;
+  } else if (panel->rotation == 270) {
+    // panel (x, y) shows (height - 1 - y, x) of the drawing area
+    r->x = d.y;
+    r->y = panel->height - d.x - d.w;
+  } else {
+    return;
+  }
+  r->w = d.h;
+  r->h = d.w;
+}
+
+// Start writing a panel buffer, or the rectangles of the drawing area in
+// it. The data of the last rectangle may be still in flight, the buffer
+// stays valid until ssd1306_frame_finish(), which must follow also if
+// failed. The buffer is already rotated to the panel.
+// The number of data bytes sent is added to sent.
+xfer_err_t
+ssd1306_frame_start(ssd1306_t *panel, const uint8_t *buffer, const tinygrafx_rect_t *rects, uint8_t count, uint32_t *sent)
+{
+  bool portrait = (panel->rotation == 90) || (panel->rotation == 270);
+  tinygrafx_t area = {
+    .display_width = portrait ? panel->height : panel->width,
+    .display_height = portrait ? panel->width : panel->height
+  };
+  xfer_err_t err = XFER_OK;
+
+  oled_begin(panel->bus);
+  if (count == 0) {
+    tinygrafx_rect_t full = { 0, 0, panel->width, panel->height };
+    err = ssd1306_write_rect(panel, buffer, &full, sent);
+  }
+  for (uint8_t i = 0; (i < count) && (err == XFER_OK); i++) {
+    tinygrafx_rect_t r = rects[i];
+    if (rect_clip(area, &r)) {
+      rect_to_panel(panel, &r);
+      err = ssd1306_write_rect(panel, buffer, &r, sent);
+    }
+  }
+  return err;
+}
+
+// Wait for the data in flight and end the frame.
+// err is the result of ssd1306_frame_start().
+xfer_err_t
+ssd1306_frame_finish(ssd1306_t *panel, xfer_err_t err)
+{
+  xfer_err_t done = oled_wait(panel->bus);
+
+  oled_end(panel->bus);
+  return (err != XFER_OK) ? err : done;
+}
+
+// Write a panel buffer, or the rectangles of the drawing area in it,
+// in one frame. The buffer is already rotated to the panel.
+// The number of data bytes sent is added to sent.
+xfer_err_t
+ssd1306_write_frame(ssd1306_t *panel, const uint8_t *buffer, const tinygrafx_rect_t *rects, uint8_t count, uint32_t *sent)
+{
+  xfer_err_t err = ssd1306_frame_start(panel, buffer, rects, count, sent);
+  return ssd1306_frame_finish(panel, err);
+}
+
+// Transport counting the transfer cost of a frame, by the model of the bus
+typedef struct cost_transport_t {
+  oled_transport_t base;
+  const oled_transport_t *bus;  // the bus modeled
+  oled_cost_t *cost;
+} cost_transport_t;
+
+static void
+cost_transaction(cost_transport_t *c, uint32_t len)
+{
+  c->cost->transactions++;
+  c->cost->time_ns += oled_transaction_ns(c->bus, len);
+}
+
+static void
+cost_frame(oled_transport_t *t)
+{
+}
+
+static xfer_err_t
+cost_send_cmds(oled_transport_t *t, const uint8_t *cmds, uint32_t len)
+{
+  cost_transport_t *c = (cost_transport_t *)t;
+
+  cost_transaction(c, len);
+  c->cost->cmd_bytes += len;
+  return XFER_OK;
+}
+
+static xfer_err_t
+cost_send_data_async(oled_transport_t *t, const uint8_t *data, uint32_t len)
+{
+  cost_transport_t *c = (cost_transport_t *)t;
+  uint32_t chunk = (c->bus->max_chunk > 0) ? c->bus->max_chunk : len;
+
+  c->cost->data_bytes += len;
+  while (len > 0) {
+    uint32_t tx_len = (len > chunk) ? chunk : len;
+    cost_transaction(c, tx_len);
+    len -= tx_len;
+  }
+  return XFER_OK;
+}
+
+static xfer_err_t
+cost_wait(oled_transport_t *t)
+{
+  return XFER_OK;
+}
+
+static const oled_transport_ops_t cost_ops = {
+  .begin = cost_frame,
+  .end = cost_frame,
+  .send_cmds = cost_send_cmds,
+  .send_data_async = cost_send_data_async,
+  .wait = cost_wait
+};
+
+// Estimate the transfer cost of ssd1306_write_frame() on the bus of the
+// panel, without sending. The pending control commands are counted.
+void
+ssd1306_estimate_frame(const ssd1306_t *panel, const uint8_t *buffer, const tinygrafx_rect_t *rects, uint8_t count, oled_cost_t *cost)
+{
+  cost_transport_t counter = { .base.ops = &cost_ops, .bus = panel->bus, .cost = cost };
+  ssd1306_t shadow = *panel;
+  uint32_t sent = 0;
+
+  memset(cost, 0, sizeof(oled_cost_t));
+  shadow.bus = &counter.base;
+  ssd1306_write_frame(&shadow, buffer, rects, count, &sent);
+}
@@ -0,0 +1,56 @@
+#ifndef SSD1306H_
+#define SSD1306H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tiny_grafx.h"
+#include "oled_transport.h"
+
+// Display controller
+enum {
+    CTRL_SSD1306,   // 128 column RAM, horizontal addressing mode
+    CTRL_SH1106     // 132 column RAM, page addressing mode only
+};
+
+// Column RAM width of the controllers
+#define SSD1306_RAM_WIDTH   128
+#define SH1106_RAM_WIDTH    132
+
+// Longest init command sequence built by ssd1306_build_init_cmds()
+#define INIT_CMDS_MAX_SIZE  32
+
+// Pending control commands, sent with the next frame or by flush
+#define PENDING_CONTRAST    0x01
+#define PENDING_INVERT      0x02
+#define PENDING_FLIP        0x04
+#define PENDING_POWER       0x08
+#define PENDING_CMDS_MAX_SIZE 6
+
+// Panel state of the controller
+typedef struct ssd1306_t {
+  oled_transport_t *bus;    // Transport to the controller
+  uint8_t controller;       // Display controller (SSD1306 or SH1106)
+  uint8_t width;            // Panel width [pixel]
+  uint8_t height;           // Panel height [pixel]
+  uint8_t pages;            // Panel height in 8 pixel pages
+  uint8_t col_offset;       // First visible column in the controller RAM
+  uint8_t contrast;         // Contrast (0-255)
+  bool inverted;            // Inverse display
+  bool power;               // Display ON
+  bool flip_h;              // Mirror horizontally (segment re-map)
+  bool flip_v;              // Mirror vertically (COM scan direction)
+  int16_t rotation;         // Rotation [degree] clockwise, 0, 90, 180 or 270
+  uint8_t pending;          // Control commands waiting for the next frame
+} ssd1306_t;
+
+uint8_t ssd1306_ram_width(uint8_t controller);
+uint16_t ssd1306_build_init_cmds(ssd1306_t *panel, uint8_t *cmds);
+xfer_err_t ssd1306_init(ssd1306_t *panel);
+xfer_err_t ssd1306_flush_cmds(ssd1306_t *panel);
+xfer_err_t ssd1306_frame_start(ssd1306_t *panel, const uint8_t *buffer, const tinygrafx_rect_t *rects, uint8_t count, uint32_t *sent);
+xfer_err_t ssd1306_frame_finish(ssd1306_t *panel, xfer_err_t err);
+xfer_err_t ssd1306_write_frame(ssd1306_t *panel, const uint8_t *buffer, const tinygrafx_rect_t *rects, uint8_t count, uint32_t *sent);
+void ssd1306_estimate_frame(const ssd1306_t *panel, const uint8_t *buffer, const tinygrafx_rect_t *rects, uint8_t count, oled_cost_t *cost);
+
+#endif /* SSD1306H_ */
@@ -33,9 +33,9 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include "esp_err.h"
-#include "esp_log.h"
+#include "oled_platform.h"
 static const char *TAG = "TINY_GRAFX";
 
 // 8x8 monochrome bitmap fonts from font8x8_basic.h by dhepper/font8x8
@@ -54,33 +54,153 @@ static const char *TAG = "TINY_GRAFX";
 void 
 buffer_clear(tinygrafx_t tg) 
 {
-  memset(tg.display_buffer, 0x00, tg.display_pixel);
+  memset(tg.display_buffer, 0x00, TG_DISPLAY_PIXEL(tg));
 }
 
 void 
-buffer_read(tinygrafx_t tg, uint8_t *data, int16_t size) 
+buffer_read(tinygrafx_t tg, uint8_t *data, uint32_t size) 
 {
   if (data == NULL) {
     ESP_LOGI(TAG, "buffer_read: data NULL error");
   }
-  if (size == tg.display_pixel) {
-    for (int16_t i=0; i<tg.display_pixel; i++) {
-      data[i] = tg.display_buffer[i];
-    }
+  if (size == TG_DISPLAY_PIXEL(tg)) {
+    memcpy(data, tg.display_buffer, size);
   }
   else {
-    ESP_LOGI(TAG, "buffer_read: data size mismatch => %d", size);
+    ESP_LOGI(TAG, "buffer_read: data size mismatch => %u", size);
+  }
+}
+
+// Transpose a 8x8 bit matrix (transpose8 from Hacker's Delight).
+// x holds the rows 0-3 and y the rows 4-7, row 0 in the top byte.
+// Row i of out is column i of in, MSB is the left most column.
+static void
+transpose8_words(uint32_t x, uint32_t y, uint8_t *out, int16_t out_stride)
+{
+  uint32_t t;
+
+  t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+  t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+  t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+  t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+  y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+  x = t;
+
+  out[0] = x >> 24;
+  out[out_stride] = x >> 16;
+  out[2 * out_stride] = x >> 8;
+  out[3 * out_stride] = x;
+  out[4 * out_stride] = y >> 24;
+  out[5 * out_stride] = y >> 16;
+  out[6 * out_stride] = y >> 8;
+  out[7 * out_stride] = y;
+}
+
+static void
+transpose8(const uint8_t *in, int16_t in_stride, uint8_t *out, int16_t out_stride)
+{
+  uint32_t x, y;
+
+  // the bytes are promoted to int, shifted as unsigned
+  x = ((uint32_t)in[0] << 24) | ((uint32_t)in[in_stride] << 16) | ((uint32_t)in[2 * in_stride] << 8) | in[3 * in_stride];
+  y = ((uint32_t)in[4 * in_stride] << 24) | ((uint32_t)in[5 * in_stride] << 16) | ((uint32_t)in[6 * in_stride] << 8) | in[7 * in_stride];
+  transpose8_words(x, y, out, out_stride);
+}
+
+// Transpose a 8x8 bit matrix in the page format, LSB is the top row.
+// bit j of out[m] = bit m of in[j]
+void 
+bitmap_transpose8x8(const uint8_t *in, int16_t in_stride, uint8_t *out, int16_t out_stride) 
+{
+  transpose8(in + 7 * in_stride, -in_stride, out + 7 * out_stride, -out_stride);
+}
+
+// Read the frame buffer rotated by 90 or 270 degrees clockwise.
+// The panel is display_height x display_width, both multiple of 8.
+void 
+buffer_read_rotate(tinygrafx_t tg, uint8_t *data, int16_t rotation) 
+{
+  uint16_t panel_width = TG_DISPLAY_HEIGHT(tg);
+  uint16_t panel_pages = TG_DISPLAY_WIDTH(tg) / 8;
+  uint16_t blocks = panel_width / 8;
+  const uint8_t *in;
+  uint8_t *out;
+
+  for (uint16_t page = 0; page < panel_pages; page++) {
+    for (uint16_t k = 0; k < blocks; k++) {
+      out = data + page * panel_width + k * 8;
+      if (rotation == 90) {
+        // panel column x shows the row (panel_width - 1 - x)
+        in = tg.display_buffer + (blocks - 1 - k) * TG_DISPLAY_WIDTH(tg) + page * 8;
+        transpose8(in + 7, -1, out, 1);
+      } else {
+        // panel row y shows the column (display_width - 1 - y)
+        in = tg.display_buffer + k * TG_DISPLAY_WIDTH(tg) + (panel_pages - 1 - page) * 8;
+        transpose8(in, 1, out + 7, -1);
+      }
+    }
+  }
+}
+
+// FNV-1a hash of a page of the frame buffer
+uint32_t 
+buffer_page_hash(tinygrafx_t tg, int16_t page) 
+{
+  const uint8_t *p = tg.display_buffer + page * TG_DISPLAY_WIDTH(tg);
+  uint32_t hash = 2166136261u;
+
+  for (int16_t i = 0; i < TG_DISPLAY_WIDTH(tg); i++) {
+    hash ^= p[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Clip the rectangle to the drawing area, false if nothing is left.
+// The area is of tg even in the fixed geometry build, the callers clip
+// to the panel in the controller orientation.
+bool 
+rect_clip(tinygrafx_t tg, tinygrafx_rect_t *r) 
+{
+  if (r->x < 0) {
+    r->w += r->x;
+    r->x = 0;
+  }
+  if (r->y < 0) {
+    r->h += r->y;
+    r->y = 0;
   }
+  if ((r->x + r->w) > tg.display_width) {
+    r->w = tg.display_width - r->x;
+  }
+  if ((r->y + r->h) > tg.display_height) {
+    r->h = tg.display_height - r->y;
+  }
+  return (r->w > 0) && (r->h > 0);
+}
+
+// Grow the rectangle to cover the other one
+void 
+rect_union(tinygrafx_rect_t *r, const tinygrafx_rect_t *add) 
+{
+  int16_t x1 = (r->x + r->w > add->x + add->w) ? (r->x + r->w) : (add->x + add->w);
+  int16_t y1 = (r->y + r->h > add->y + add->h) ? (r->y + r->h) : (add->y + add->h);
+
+  r->x = (r->x < add->x) ? r->x : add->x;
+  r->y = (r->y < add->y) ? r->y : add->y;
+  r->w = x1 - r->x;
+  r->h = y1 - r->y;
 }
 
 void 
 set_pixel(tinygrafx_t tg, int16_t x, int16_t y, uint16_t color) 
 {
-  if ((x >= 0) && (x < tg.display_width) && (y >= 0) && (y < tg.display_height)) {
+  if ((x >= 0) && (x < TG_DISPLAY_WIDTH(tg)) && (y >= 0) && (y < TG_DISPLAY_HEIGHT(tg))) {
     switch (color) {
-      case WHITE: tg.display_buffer[x + (y / 8) * tg.display_width] |=  (1 << (y & 7)); break;
-      case BLACK: tg.display_buffer[x + (y / 8) * tg.display_width] &= ~(1 << (y & 7)); break;
-      case INVERT:tg.display_buffer[x + (y / 8) * tg.display_width] ^=  (1 << (y & 7)); break;
+      case WHITE: tg.display_buffer[x + (y / 8) * TG_DISPLAY_WIDTH(tg)] |=  (1 << (y & 7)); break;
+      case BLACK: tg.display_buffer[x + (y / 8) * TG_DISPLAY_WIDTH(tg)] &= ~(1 << (y & 7)); break;
+      case INVERT:tg.display_buffer[x + (y / 8) * TG_DISPLAY_WIDTH(tg)] ^=  (1 << (y & 7)); break;
     }
   } 
 }
@@ -88,8 +208,8 @@ set_pixel(tinygrafx_t tg, int16_t x, int16_t y, uint16_t color)
 int16_t 
 get_pixel(tinygrafx_t tg, int16_t x, int16_t y) 
 {
-  if ((x >= 0) && (x < tg.display_width) && (y >= 0) && (y < tg.display_height)) {
-    return (tg.display_buffer[x + (y / 8) * tg.display_width] >> (y % 8)) & 0x1;
+  if ((x >= 0) && (x < TG_DISPLAY_WIDTH(tg)) && (y >= 0) && (y < TG_DISPLAY_HEIGHT(tg))) {
+    return (tg.display_buffer[x + (y / 8) * TG_DISPLAY_WIDTH(tg)] >> (y % 8)) & 0x1;
   }
   else {
     return 0;
@@ -145,8 +265,8 @@ draw_vertical_line(tinygrafx_t tg, int16_t x, int16_t y, int16_t h, int16_t colo
     y = 0;
   }
 
-  if ((y + h) > tg.display_height) {
-    h = tg.display_height - y; 
+  if ((y + h) > TG_DISPLAY_HEIGHT(tg)) {
+    h = TG_DISPLAY_HEIGHT(tg) - y; 
   }
 
   if (h <= 0) return;
@@ -164,8 +284,8 @@ draw_horizontal_line(tinygrafx_t tg, int16_t x, int16_t y, int16_t w, int16_t co
     x = 0;
   }
 
-  if ((x + w) > tg.display_width) {
-    w = tg.display_width - x; 
+  if ((x + w) > TG_DISPLAY_WIDTH(tg)) {
+    w = TG_DISPLAY_WIDTH(tg) - x; 
   }
 
   if (w <= 0) return;
@@ -248,15 +368,28 @@ draw_fill_circle(tinygrafx_t tg, int16_t x0, int16_t y0, int16_t r, int16_t colo
 	} while (x < y);
 }
 
+// Read the rows of a glyph from the flash as two aligned words,
+// lo holds the rows 0-3 and hi the rows 4-7, row 0 in the low byte.
+static void
+font_glyph(uint8_t c, uint32_t *lo, uint32_t *hi)
+{
+  const uint32_t *glyph = (const uint32_t *)font8x8_basic[c & 0x7F];
+
+  *lo = glyph[0];
+  *hi = glyph[1];
+}
+
 // Display a character string
 void 
 draw_char(tinygrafx_t tg, int16_t x, int16_t y, uint8_t c, int16_t color, int16_t fontsize) 
 {
   uint8_t row_pixel;
   uint16_t font_width;
+  uint32_t lo, hi;
 
+  font_glyph(c, &lo, &hi);
   for (int16_t y1 = 0; y1 < tg.font_height; y1++) {  
-    row_pixel = font8x8_basic[c][y1];
+    row_pixel = (y1 < 4) ? (lo >> (y1 * 8)) : (hi >> ((y1 - 4) * 8));
 
     for (int16_t x1 = 0; x1 < tg.font_width; x1++) {
       if (row_pixel & 0x01) {
@@ -298,3 +431,18 @@ display_text(tinygrafx_t tg, int16_t x, int16_t y, uint8_t *text, int16_t length
   }
 }
 
+
+// Write a character on a page, the column x is not clipped by the page.
+// Faster than draw_char, the glyph is transposed into 8 page bytes.
+void 
+draw_char_page(tinygrafx_t tg, int16_t x, int16_t page, uint8_t c) 
+{
+  if ((x < 0) || (x + tg.font_width > TG_DISPLAY_WIDTH(tg)) || (page < 0) || (page >= TG_DISPLAY_PAGES(tg))) {
+    return;
+  }
+  uint32_t lo, hi;
+
+  font_glyph(c, &lo, &hi);
+  // the same as bitmap_transpose8x8(glyph, 1, out, 1) on a little endian CPU
+  transpose8_words(hi, lo, tg.display_buffer + page * TG_DISPLAY_WIDTH(tg) + x + 7, -1);
+}
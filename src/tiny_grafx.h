@@ -1,16 +1,47 @@
 #ifndef TINYGRAFXH_
 #define TINYGRAFXH_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 // TINYGRAFX config
 typedef struct tinygrafx_t {
   uint16_t display_width;
   uint16_t display_height;
-  uint16_t display_pixel;
+  uint16_t display_pages;
+  uint32_t display_pixel;
   uint8_t font_width;
   uint8_t font_height;
   uint8_t *display_buffer;
 } tinygrafx_t;
 
+// Fixed geometry build. With TG_WIDTH and TG_HEIGHT defined by
+// SSD1306_FIXED_GEOMETRY (see mrbgem.rake), the drawing area is a compile
+// time constant, and the drawing functions do not load it from tg.
+#if defined(TG_WIDTH) && defined(TG_HEIGHT)
+#if (TG_HEIGHT % 8) != 0
+#error "TG_HEIGHT must be a multiple of 8"
+#endif
+#define TG_FIXED_GEOMETRY
+#define TG_DISPLAY_WIDTH(tg)    (TG_WIDTH)
+#define TG_DISPLAY_HEIGHT(tg)   (TG_HEIGHT)
+#define TG_DISPLAY_PAGES(tg)    (TG_HEIGHT / 8)
+#define TG_DISPLAY_PIXEL(tg)    ((uint32_t)TG_WIDTH * (TG_HEIGHT / 8))
+#else
+#define TG_DISPLAY_WIDTH(tg)    ((tg).display_width)
+#define TG_DISPLAY_HEIGHT(tg)   ((tg).display_height)
+#define TG_DISPLAY_PAGES(tg)    ((tg).display_pages)
+#define TG_DISPLAY_PIXEL(tg)    ((tg).display_pixel)
+#endif
+
+// Rectangle area
+typedef struct tinygrafx_rect_t {
+  int16_t x;
+  int16_t y;
+  int16_t w;
+  int16_t h;
+} tinygrafx_rect_t;
+
 #define BLACK   0
 #define WHITE   1
 #define INVERT  2
@@ -19,7 +50,12 @@ typedef struct tinygrafx_t {
 #define swap_int16_t(a, b) { int16_t t = a; a = b; b = t; }
 
 void buffer_clear(tinygrafx_t tg);
-void buffer_read(tinygrafx_t tg, uint8_t *data, int16_t size);
+void buffer_read(tinygrafx_t tg, uint8_t *data, uint32_t size);
+uint32_t buffer_page_hash(tinygrafx_t tg, int16_t page);
+void buffer_read_rotate(tinygrafx_t tg, uint8_t *data, int16_t rotation);
+void bitmap_transpose8x8(const uint8_t *in, int16_t in_stride, uint8_t *out, int16_t out_stride);
+bool rect_clip(tinygrafx_t tg, tinygrafx_rect_t *r);
+void rect_union(tinygrafx_rect_t *r, const tinygrafx_rect_t *add);
 void set_pixel(tinygrafx_t tg, int16_t x, int16_t y, uint16_t color) ;
 int16_t get_pixel(tinygrafx_t tg, int16_t x, int16_t y);
 void draw_line(tinygrafx_t tg, int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t color);
@@ -32,6 +68,7 @@ void draw_fill_circle(tinygrafx_t tg, int16_t x0, int16_t y0, int16_t r, int16_t
 
 // Display a character string
 void draw_char(tinygrafx_t tg, int16_t x, int16_t y, uint8_t c, int16_t color, int16_t fontsize);
+void draw_char_page(tinygrafx_t tg, int16_t x, int16_t page, uint8_t c);
 void display_text(tinygrafx_t tg, int16_t x, int16_t y, uint8_t *text, int16_t length, int16_t color, int16_t fontsize);
 
 #endif /* TINYGRAFXH_ */
@@ -0,0 +1,224 @@
+// ===================================================================
+//
+//    I2C transport for SSD1306
+//
+// ===================================================================
+//
+// Each transaction starts with the control byte after the address.
+//
+//   0x00 : command stream, the rest of the bytes are commands
+//   0x40 : data stream, the rest of the bytes are the display data
+//
+// The data of a frame is sent in one burst, without the control byte
+// per 16 or 32 bytes. The I2C driver is blocking, so the data is sent
+// before send_data_async returns.
+//
+// ===================================================================
+
+#ifdef ESP_PLATFORM
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "driver/i2c.h"
+#include "driver/gpio.h"
+
+#include "oled_transport.h"
+
+#define I2C_CONTROL_CMDS    0x00
+#define I2C_CONTROL_DATA    0x40
+
+typedef struct transport_i2c_t {
+  oled_transport_t base;
+  oled_i2c_config_t cfg;
+  struct transport_i2c_t *next;   // Next display on the port
+  bool require_reset;       // Reset the display, the first one on the port
+} transport_i2c_t;
+
+static const char *TAG = "I2C_SSD1306";
+
+// Displays on each I2C port, the driver is deleted after the last one
+static uint8_t i2c_port_devices[I2C_NUM_MAX];
+static transport_i2c_t *i2c_port_list[I2C_NUM_MAX];
+
+// Configure the port as the I2C master at clock_hz
+static esp_err_t
+i2c_port_config(const oled_i2c_config_t *cfg, uint32_t clock_hz)
+{
+  i2c_config_t conf = {
+    .mode = I2C_MODE_MASTER,
+    .sda_io_num = cfg->sda,
+    .sda_pullup_en = GPIO_PULLUP_ENABLE,
+    .scl_io_num = cfg->scl,
+    .scl_pullup_en = GPIO_PULLUP_ENABLE,
+    .master.clk_speed = clock_hz
+  };
+  return i2c_param_config(cfg->port, &conf);
+}
+
+// One I2C transaction, the address, the control byte and the bytes
+static xfer_err_t
+i2c_write(transport_i2c_t *t, uint8_t control, const uint8_t *bytes, uint32_t len)
+{
+  TickType_t ticks = t->base.timeout_ms / portTICK_PERIOD_MS;
+  esp_err_t err;
+
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (t->cfg.addr << 1) | I2C_MASTER_WRITE, true);
+  i2c_master_write_byte(cmd, control, true);
+  i2c_master_write(cmd, (uint8_t *)bytes, len, true);
+  i2c_master_stop(cmd);
+  err = i2c_master_cmd_begin(t->cfg.port, cmd, (ticks > 0) ? ticks : 1);
+  i2c_cmd_link_delete(cmd);
+
+  if (err == ESP_OK) {
+    return XFER_OK;
+  }
+  ESP_LOGI(TAG, "i2c_write: i2c_master_cmd_begin error=%d", err);
+  t->base.last_error = err;
+  if (err == ESP_ERR_TIMEOUT) {
+    t->base.timeouts++;
+    return XFER_TIMEOUT;
+  }
+  return XFER_ERROR;
+}
+
+static void
+i2c_begin(oled_transport_t *base)
+{
+}
+
+static void
+i2c_end(oled_transport_t *base)
+{
+}
+
+static xfer_err_t
+i2c_send_cmds(oled_transport_t *base, const uint8_t *cmds, uint32_t len)
+{
+  return i2c_write((transport_i2c_t *)base, I2C_CONTROL_CMDS, cmds, len);
+}
+
+static xfer_err_t
+i2c_send_data_async(oled_transport_t *base, const uint8_t *data, uint32_t len)
+{
+  return i2c_write((transport_i2c_t *)base, I2C_CONTROL_DATA, data, len);
+}
+
+static xfer_err_t
+i2c_wait(oled_transport_t *base)
+{
+  return XFER_OK;
+}
+
+// Reset the display only by the first one on the port,
+// another display may share the reset line.
+static void
+i2c_reset(oled_transport_t *base)
+{
+  transport_i2c_t *t = (transport_i2c_t *)base;
+
+  if ((t->cfg.rst >= 0) && t->require_reset) {
+    gpio_set_level(t->cfg.rst, 1);
+    gpio_set_level(t->cfg.rst, 0);
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+    gpio_set_level(t->cfg.rst, 1);
+  }
+}
+
+// Set the SCL clock, shared by the displays on the port,
+// so the clock of every display on the port is changed.
+static xfer_err_t
+i2c_set_clock(oled_transport_t *base, uint32_t clock_hz)
+{
+  transport_i2c_t *t = (transport_i2c_t *)base;
+  esp_err_t err = i2c_port_config(&t->cfg, clock_hz);
+
+  if (err != ESP_OK) {
+    ESP_LOGI(TAG, "i2c_set_clock: i2c_param_config error=%d", err);
+    t->base.last_error = err;
+    return XFER_ERROR;
+  }
+  for (transport_i2c_t *d = i2c_port_list[t->cfg.port]; d != NULL; d = d->next) {
+    d->cfg.freq = clock_hz;
+    d->base.clock_hz = clock_hz;
+  }
+  return XFER_OK;
+}
+
+static void
+i2c_free(oled_transport_t *base)
+{
+  transport_i2c_t *t = (transport_i2c_t *)base;
+
+  for (transport_i2c_t **d = &i2c_port_list[t->cfg.port]; *d != NULL; d = &(*d)->next) {
+    if (*d == t) {
+      *d = t->next;
+      break;
+    }
+  }
+  i2c_port_devices[t->cfg.port]--;
+  if (i2c_port_devices[t->cfg.port] == 0) {
+    esp_err_t err = i2c_driver_delete(t->cfg.port);
+    if (err != ESP_OK) {
+      ESP_LOGI(TAG, "i2c_free: i2c_driver_delete status=%d", err);
+    }
+  }
+  free(t);
+}
+
+static const oled_transport_ops_t i2c_ops = {
+  .begin = i2c_begin,
+  .end = i2c_end,
+  .send_cmds = i2c_send_cmds,
+  .send_data_async = i2c_send_data_async,
+  .wait = i2c_wait,
+  .reset = i2c_reset,
+  .set_clock = i2c_set_clock,
+  .free = i2c_free
+};
+
+// Install the I2C master driver for the first display on the port.
+// Returns NULL if failed.
+oled_transport_t *
+oled_i2c_create(const oled_i2c_config_t *cfg)
+{
+  esp_err_t err;
+
+  if (cfg->port >= I2C_NUM_MAX) {
+    return NULL;
+  }
+  transport_i2c_t *t = (transport_i2c_t *)calloc(1, sizeof(transport_i2c_t));
+  if (t == NULL) {
+    return NULL;
+  }
+  t->base.ops = &i2c_ops;
+  t->base.type = OLED_BUS_I2C;
+  oled_model_init(&t->base, OLED_BUS_I2C, cfg->freq, OLED_I2C_OVERHEAD_NS);
+  t->cfg = *cfg;
+
+  if (i2c_port_devices[cfg->port] == 0) {
+    t->require_reset = true;
+    err = i2c_port_config(cfg, cfg->freq);
+    if (err == ESP_OK) {
+      err = i2c_driver_install(cfg->port, I2C_MODE_MASTER, 0, 0, 0);
+    }
+    if (err != ESP_OK) {
+      ESP_LOGI(TAG, "oled_i2c_create: i2c driver status=%d", err);
+      free(t);
+      return NULL;
+    }
+  }
+  i2c_port_devices[cfg->port]++;
+  t->next = i2c_port_list[cfg->port];
+  i2c_port_list[cfg->port] = t;
+
+  if (cfg->rst >= 0) {
+    gpio_set_direction(cfg->rst, GPIO_MODE_OUTPUT);
+  }
+  return &t->base;
+}
+
+#endif /* ESP_PLATFORM */
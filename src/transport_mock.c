@@ -0,0 +1,152 @@
+// ===================================================================
+//
+//    Mock transport for SSD1306
+//
+// ===================================================================
+//
+// Records the commands and the data sent to the display in a log, and
+// adds up the simulated transfer time of each transaction by the model
+// of oled_transport.h, as SPI or I2C.
+//
+// Runs on a host, to test and benchmark the controller logic.
+//
+// ===================================================================
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "oled_transport.h"
+
+// Append a transaction to the log, dropped if the log is full
+static void
+mock_log(oled_mock_t *mock, uint8_t kind, const uint8_t *bytes, uint32_t len)
+{
+  if ((len > UINT16_MAX) || (mock->log_used + 3 + len > mock->log_size)) {
+    mock->log_dropped++;
+    return;
+  }
+  uint8_t *p = mock->log + mock->log_used;
+  p[0] = kind;
+  p[1] = len & 0xFF;
+  p[2] = (len >> 8) & 0xFF;
+  if (len > 0) {
+    memcpy(p + 3, bytes, len);
+  }
+  mock->log_used += 3 + len;
+}
+
+static void
+mock_transaction(oled_mock_t *mock, uint8_t kind, const uint8_t *bytes, uint32_t len)
+{
+  mock_log(mock, kind, bytes, len);
+  mock->transactions++;
+  mock->sim_time_ns += oled_transaction_ns(&mock->base, len);
+}
+
+static void
+mock_begin(oled_transport_t *t)
+{
+  ((oled_mock_t *)t)->frames++;
+}
+
+static void
+mock_end(oled_transport_t *t)
+{
+}
+
+static xfer_err_t
+mock_send_cmds(oled_transport_t *t, const uint8_t *cmds, uint32_t len)
+{
+  oled_mock_t *mock = (oled_mock_t *)t;
+
+  mock_transaction(mock, OLED_MOCK_CMDS, cmds, len);
+  mock->cmd_bytes += len;
+  return XFER_OK;
+}
+
+static xfer_err_t
+mock_send_data_async(oled_transport_t *t, const uint8_t *data, uint32_t len)
+{
+  oled_mock_t *mock = (oled_mock_t *)t;
+
+  mock_transaction(mock, OLED_MOCK_DATA, data, len);
+  mock->data_bytes += len;
+  return XFER_OK;
+}
+
+static xfer_err_t
+mock_wait(oled_transport_t *t)
+{
+  return XFER_OK;
+}
+
+static void
+mock_reset(oled_transport_t *t)
+{
+  oled_mock_t *mock = (oled_mock_t *)t;
+
+  mock_log(mock, OLED_MOCK_RESET, NULL, 0);
+  mock->resets++;
+}
+
+static xfer_err_t
+mock_set_clock(oled_transport_t *t, uint32_t clock_hz)
+{
+  t->clock_hz = clock_hz;
+  return XFER_OK;
+}
+
+static void
+mock_free(oled_transport_t *t)
+{
+  oled_mock_t *mock = (oled_mock_t *)t;
+
+  free(mock->log);
+  free(mock);
+}
+
+static const oled_transport_ops_t mock_ops = {
+  .begin = mock_begin,
+  .end = mock_end,
+  .send_cmds = mock_send_cmds,
+  .send_data_async = mock_send_data_async,
+  .wait = mock_wait,
+  .reset = mock_reset,
+  .set_clock = mock_set_clock,
+  .free = mock_free
+};
+
+// Create a mock of SPI or I2C bus, with log_size bytes of the traffic log.
+// Returns NULL if no memory.
+oled_transport_t *
+oled_mock_create(oled_bus_t bus, uint32_t clock_hz, uint32_t overhead_ns, uint32_t log_size)
+{
+  oled_mock_t *mock = (oled_mock_t *)calloc(1, sizeof(oled_mock_t));
+  if (mock == NULL) {
+    return NULL;
+  }
+  mock->log = (uint8_t *)malloc(log_size);
+  if ((mock->log == NULL) && (log_size > 0)) {
+    free(mock);
+    return NULL;
+  }
+  mock->base.ops = &mock_ops;
+  mock->base.type = OLED_BUS_MOCK;
+  oled_model_init(&mock->base, bus, clock_hz, overhead_ns);
+  mock->log_size = log_size;
+  return &mock->base;
+}
+
+// Clear the log and the counters
+void
+oled_mock_clear(oled_mock_t *mock)
+{
+  mock->log_used = 0;
+  mock->log_dropped = 0;
+  mock->transactions = 0;
+  mock->cmd_bytes = 0;
+  mock->data_bytes = 0;
+  mock->frames = 0;
+  mock->resets = 0;
+  mock->sim_time_ns = 0;
+}
@@ -0,0 +1,337 @@
+// ===================================================================
+//
+//    SPI transport for SSD1306
+//
+// ===================================================================
+//
+// 4-wire SPI, the D/C line and CS are driven by GPIO. CS is held low
+// over a frame, so the commands and the data of a frame are sent in
+// one CS window. With DMA the data is queued and sent in the
+// background, without DMA up to 32 bytes are sent at a time.
+//
+// ===================================================================
+
+#ifdef ESP_PLATFORM
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "driver/spi_master.h"
+#include "driver/gpio.h"
+
+#include "oled_transport.h"
+
+// SPI HOST, only HSPI or VSPI
+#define OLED_SPI_HOST VSPI_HOST
+
+// NO_DMA mode transaction data size is up to 32 bytes at a time.
+#define NO_DMA_TRANSACTION_DATA_SIZE 32
+
+// D/C pin mode, command or data
+enum {
+    DC_CMD,
+    DC_DATA
+};
+
+typedef struct transport_spi_t {
+  oled_transport_t base;
+  oled_spi_config_t cfg;
+  spi_device_handle_t spi;  // Handle for a device on a SPI bus
+  spi_transaction_t tx;     // Transaction, kept while the driver may hold it
+  bool in_flight;           // The result of tx is not collected yet
+  bool require_reset;       // Reset the display, the bus was not in use
+} transport_spi_t;
+
+static const char *TAG = "SPI_SSD1306";
+
+// Displays on the SPI bus, the bus is freed when the last one is removed
+static uint8_t spi_bus_devices;
+static bool spi_bus_owner;      // the bus was initialized by this library
+
+// Record an error of the SPI driver
+static xfer_err_t
+spi_error(transport_spi_t *t, const char *func, esp_err_t err)
+{
+  ESP_LOGI(TAG, "send_data: %s error=%d", func, err);
+  t->base.last_error = err;
+  if (err == ESP_ERR_TIMEOUT) {
+    t->base.timeouts++;
+    return XFER_TIMEOUT;
+  }
+  return XFER_ERROR;
+}
+
+static TickType_t
+spi_timeout(transport_spi_t *t)
+{
+  TickType_t ticks = t->base.timeout_ms / portTICK_PERIOD_MS;
+  return (ticks > 0) ? ticks : 1;
+}
+
+// Collect the result of the transaction in flight.
+// The transaction timed out stays in flight, and is collected later.
+static xfer_err_t
+spi_collect(transport_spi_t *t)
+{
+  spi_transaction_t *rx;
+
+  if (!t->in_flight) {
+    return XFER_OK;
+  }
+  esp_err_t err = spi_device_get_trans_result(t->spi, &rx, spi_timeout(t));
+  if (err != ESP_OK) {
+    return spi_error(t, "spi_device_get_trans_result", err);
+  }
+  t->in_flight = false;
+  return XFER_OK;
+}
+
+// Queue a transaction after the one in flight
+static xfer_err_t
+spi_queue(transport_spi_t *t, const uint8_t *data, uint32_t len, int32_t dc)
+{
+  xfer_err_t result = spi_collect(t);
+  if (result != XFER_OK) {
+    return result;
+  }
+  if (t->spi == NULL) {
+    // detached by a failed clock change
+    return spi_error(t, "spi_device_queue_trans", ESP_ERR_INVALID_STATE);
+  }
+
+  // spi pre-transfer setting, D/C line.
+  gpio_set_level(t->cfg.dc, dc);
+
+  memset(&t->tx, 0, sizeof(spi_transaction_t));
+  t->tx.length = len * 8;         // len is in bytes, transaction length is in bits.
+  t->tx.tx_buffer = data;         // Transmit data
+  t->tx.user = (void*)dc;         // D/C needs to be set to 1
+  esp_err_t err = spi_device_queue_trans(t->spi, &t->tx, spi_timeout(t));
+  if (err != ESP_OK) {
+    return spi_error(t, "spi_device_queue_trans", err);
+  }
+  t->in_flight = true;
+  return XFER_OK;
+}
+
+// Select the display. CS stays low until spi_end(), so the commands
+// and the data of a frame are sent in one CS window.
+static void
+spi_begin(oled_transport_t *base)
+{
+  transport_spi_t *t = (transport_spi_t *)base;
+  gpio_set_level(t->cfg.cs, 0);
+}
+
+static void
+spi_end(oled_transport_t *base)
+{
+  transport_spi_t *t = (transport_spi_t *)base;
+  gpio_set_level(t->cfg.dc, 0);
+  gpio_set_level(t->cfg.cs, 1);
+}
+
+// The commands are on the caller stack, wait for them.
+static xfer_err_t
+spi_send_cmds(oled_transport_t *base, const uint8_t *cmds, uint32_t len)
+{
+  transport_spi_t *t = (transport_spi_t *)base;
+  xfer_err_t err = spi_queue(t, cmds, len, DC_CMD);
+  if (err != XFER_OK) {
+    return err;
+  }
+  return spi_collect(t);
+}
+
+// NOTE: NO_DMA mode can transmit up to 32 bytes at a time.
+static xfer_err_t
+spi_send_data_async(oled_transport_t *base, const uint8_t *data, uint32_t len)
+{
+  transport_spi_t *t = (transport_spi_t *)base;
+  xfer_err_t err;
+
+  if (t->cfg.dma_ch != 0) {
+    // Use DMA mode, sent in the background
+    return spi_queue(t, data, len, DC_DATA);
+  }
+
+  // NO_DMA mode
+  while (len > 0) {
+    uint32_t tx_len = (len > NO_DMA_TRANSACTION_DATA_SIZE) ? NO_DMA_TRANSACTION_DATA_SIZE : len;
+    if (((err = spi_queue(t, data, tx_len, DC_DATA)) != XFER_OK) || ((err = spi_collect(t)) != XFER_OK)) {
+      return err;
+    }
+    len -= tx_len;
+    data += tx_len;
+  }
+  return XFER_OK;
+}
+
+static xfer_err_t
+spi_wait(oled_transport_t *base)
+{
+  return spi_collect((transport_spi_t *)base);
+}
+
+// Reset the display if the host was not in use,
+// another display may share the reset line.
+static void
+spi_reset(oled_transport_t *base)
+{
+  transport_spi_t *t = (transport_spi_t *)base;
+
+  if (t->require_reset) {
+    gpio_set_level(t->cfg.rst, 1);
+    gpio_set_level(t->cfg.rst, 0);
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+    gpio_set_level(t->cfg.rst, 1);
+  }
+}
+
+// Attach the OLED to the SPI bus at clock_hz
+static esp_err_t
+spi_add_device(transport_spi_t *t, uint32_t clock_hz)
+{
+  spi_device_interface_config_t devcfg = {
+    .clock_speed_hz = clock_hz,
+    .mode = t->cfg.mode,
+    .spics_io_num = -1,   // CS is driven by spi_begin() to hold it over a frame
+    .queue_size = 1
+  };
+  return spi_bus_add_device(OLED_SPI_HOST, &devcfg, &t->spi);
+}
+
+// The SPI driver sets the clock when the device is added, so the device
+// is attached again at the new clock, or at the old one if failed.
+static xfer_err_t
+spi_set_clock(oled_transport_t *base, uint32_t clock_hz)
+{
+  transport_spi_t *t = (transport_spi_t *)base;
+  xfer_err_t result = spi_collect(t);
+  esp_err_t err;
+
+  if (result != XFER_OK) {
+    return result;
+  }
+  err = spi_bus_remove_device(t->spi);
+  if (err != ESP_OK) {
+    return spi_error(t, "spi_bus_remove_device", err);
+  }
+  err = spi_add_device(t, clock_hz);
+  if (err != ESP_OK) {
+    spi_error(t, "spi_bus_add_device", err);
+    if (spi_add_device(t, t->cfg.freq) != ESP_OK) {
+      // the display is detached, closed by the owner
+      t->spi = NULL;
+    }
+    return XFER_ERROR;
+  }
+  t->cfg.freq = clock_hz;
+  base->clock_hz = clock_hz;
+  return XFER_OK;
+}
+
+// Detach the OLED from the SPI bus, and free the bus after the last one.
+// NOTE: the device handle is owned by the SPI driver.
+static void
+spi_free(oled_transport_t *base)
+{
+  transport_spi_t *t = (transport_spi_t *)base;
+  spi_transaction_t *rx;
+  esp_err_t err;
+
+  // the device is not removed with a transaction in the queue,
+  // the one timed out is waited for without the timeout
+  if (t->spi != NULL) {
+    if ((spi_collect(t) != XFER_OK) && (spi_device_get_trans_result(t->spi, &rx, portMAX_DELAY) == ESP_OK)) {
+      t->in_flight = false;
+    }
+    err = spi_bus_remove_device(t->spi);
+    if (err != ESP_OK) {
+      // still attached, the driver may hold t->tx, so t is not freed
+      ESP_LOGI(TAG, "spi_free: spi_bus_remove_device status=%d", err);
+      return;
+    }
+  }
+
+  spi_bus_devices--;
+  if ((spi_bus_devices == 0) && spi_bus_owner) {
+    err = spi_bus_free(OLED_SPI_HOST);
+    if (err != ESP_OK) {
+      ESP_LOGI(TAG, "spi_free: spi_bus_free status=%d", err);
+    }
+    spi_bus_owner = false;
+  }
+  free(t);
+}
+
+static const oled_transport_ops_t spi_ops = {
+  .begin = spi_begin,
+  .end = spi_end,
+  .send_cmds = spi_send_cmds,
+  .send_data_async = spi_send_data_async,
+  .wait = spi_wait,
+  .reset = spi_reset,
+  .set_clock = spi_set_clock,
+  .free = spi_free
+};
+
+// Initialize the SPI master, and attach the OLED to the bus.
+// Returns NULL if failed.
+oled_transport_t *
+oled_spi_create(const oled_spi_config_t *cfg)
+{
+  spi_bus_config_t buscfg = {
+    .miso_io_num = cfg->miso,
+    .mosi_io_num = cfg->mosi,
+    .sclk_io_num = cfg->sck,
+    .quadwp_io_num = -1,  // WP (Write Protect) signal, or -1 if not used.
+    .quadhd_io_num = -1   // HD (HolD) signal, or -1 if not used.
+  };
+  esp_err_t err;
+
+  transport_spi_t *t = (transport_spi_t *)calloc(1, sizeof(transport_spi_t));
+  if (t == NULL) {
+    return NULL;
+  }
+  t->base.ops = &spi_ops;
+  t->base.type = OLED_BUS_SPI;
+  t->base.max_chunk = (cfg->dma_ch != 0) ? 0 : NO_DMA_TRANSACTION_DATA_SIZE;
+  oled_model_init(&t->base, OLED_BUS_SPI, cfg->freq, OLED_SPI_OVERHEAD_NS);
+  t->cfg = *cfg;
+
+  // Initialize the SPI bus, only by the first display
+  if (spi_bus_devices == 0) {
+    err = spi_bus_initialize(OLED_SPI_HOST, &buscfg, cfg->dma_ch);
+    t->require_reset = (err == ESP_ERR_INVALID_STATE) ? false : true;
+    spi_bus_owner = (err == ESP_OK);
+    if (err != ESP_OK) {
+      ESP_LOGI(TAG, "oled_spi_create: spi_bus_initialize status=%d", err);
+    }
+  }
+
+  // Attach the OLED to the SPI bus
+  err = spi_add_device(t, cfg->freq);
+  if (err != ESP_OK) {
+    ESP_LOGI(TAG, "oled_spi_create: spi_bus_add_device status=%d", err);
+    if ((spi_bus_devices == 0) && spi_bus_owner) {
+      spi_bus_free(OLED_SPI_HOST);
+      spi_bus_owner = false;
+    }
+    free(t);
+    return NULL;
+  }
+  spi_bus_devices++;
+
+  // Initialize non-SPI GPIOs
+  gpio_set_direction(cfg->dc, GPIO_MODE_OUTPUT);
+  gpio_set_direction(cfg->rst, GPIO_MODE_OUTPUT);
+  gpio_set_direction(cfg->cs, GPIO_MODE_OUTPUT);
+  gpio_set_pull_mode(cfg->cs, GPIO_PULLUP_ONLY);
+  gpio_set_level(cfg->cs, 1);
+  return &t->base;
+}
+
+#endif /* ESP_PLATFORM */
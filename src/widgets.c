@@ -0,0 +1,306 @@
+// ===================================================================
+//
+//    Retained widgets for SSD1306
+//
+// ===================================================================
+//
+// The widgets are kept in a tree (the parent is added first). Setting
+// a value marks the widget dirty, and widget_render() redraws only the
+// dirty widgets and their children, returning the damaged rectangles
+// to send to the display.
+//
+// NOTE: the children should be inside the parent, and the siblings
+// should not overlap.
+//
+// ===================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "widgets.h"
+
+#define WIDGET_INITIAL_CAPACITY 8
+#define GAUGE_ARC_STEPS         16
+
+void
+widget_tree_init(widget_tree_t *tree)
+{
+  tree->widgets = NULL;
+  tree->count = 0;
+  tree->capacity = 0;
+}
+
+void
+widget_tree_free(widget_tree_t *tree)
+{
+  for (int16_t i = 0; i < tree->count; i++) {
+    free(tree->widgets[i].bitmap);
+  }
+  free(tree->widgets);
+  widget_tree_init(tree);
+}
+
+// Returns the widget id, or -1 if the memory is full
+int16_t
+widget_add(widget_tree_t *tree, uint8_t type, int16_t parent, int16_t x, int16_t y, int16_t w, int16_t h)
+{
+  if ((parent < WIDGET_NO_PARENT) || (parent >= tree->count)) {
+    return -1;
+  }
+  if (tree->count == tree->capacity) {
+    int16_t capacity = (tree->capacity > 0) ? (tree->capacity * 2) : WIDGET_INITIAL_CAPACITY;
+    widget_t *widgets = (widget_t *)realloc(tree->widgets, capacity * sizeof(widget_t));
+    if (widgets == NULL) {
+      return -1;
+    }
+    tree->widgets = widgets;
+    tree->capacity = capacity;
+  }
+
+  widget_t *wg = &tree->widgets[tree->count];
+  memset(wg, 0, sizeof(widget_t));
+  wg->type = type;
+  wg->parent = parent;
+  wg->dirty = true;
+  wg->x = x;
+  wg->y = y;
+  wg->w = w;
+  wg->h = h;
+  wg->max = 100;
+  return tree->count++;
+}
+
+bool
+widget_set_value(widget_tree_t *tree, int16_t id, int32_t value)
+{
+  if ((id < 0) || (id >= tree->count)) {
+    return false;
+  }
+  widget_t *wg = &tree->widgets[id];
+  if (wg->value != value) {
+    wg->value = value;
+    wg->dirty = true;
+  }
+  return true;
+}
+
+// Range of the bar and the gauge
+bool
+widget_set_range(widget_tree_t *tree, int16_t id, int32_t min, int32_t max)
+{
+  if ((id < 0) || (id >= tree->count)) {
+    return false;
+  }
+  widget_t *wg = &tree->widgets[id];
+  if ((wg->min != min) || (wg->max != max)) {
+    wg->min = min;
+    wg->max = max;
+    wg->dirty = true;
+  }
+  return true;
+}
+
+bool
+widget_set_text(widget_tree_t *tree, int16_t id, const char *text, int16_t length)
+{
+  if ((id < 0) || (id >= tree->count)) {
+    return false;
+  }
+  widget_t *wg = &tree->widgets[id];
+  if (length >= WIDGET_TEXT_SIZE) {
+    length = WIDGET_TEXT_SIZE - 1;
+  }
+  if ((strncmp(wg->text, text, length) != 0) || (wg->text[length] != '\0')) {
+    memcpy(wg->text, text, length);
+    wg->text[length] = '\0';
+    wg->dirty = true;
+  }
+  return true;
+}
+
+bool
+widget_set_bitmap(widget_tree_t *tree, int16_t id, const uint8_t *bitmap, uint32_t size)
+{
+  if ((id < 0) || (id >= tree->count)) {
+    return false;
+  }
+  widget_t *wg = &tree->widgets[id];
+  uint8_t *copy = (uint8_t *)malloc(size);
+  if (copy == NULL) {
+    return false;
+  }
+  memcpy(copy, bitmap, size);
+  free(wg->bitmap);
+  wg->bitmap = copy;
+  wg->dirty = true;
+  return true;
+}
+
+// Redraw all widgets on the next render
+void
+widget_invalidate(widget_tree_t *tree)
+{
+  for (int16_t i = 0; i < tree->count; i++) {
+    tree->widgets[i].dirty = true;
+  }
+}
+
+// Bounds on the drawing area
+static tinygrafx_rect_t
+widget_bounds(widget_tree_t *tree, widget_t *wg)
+{
+  tinygrafx_rect_t r = { wg->x, wg->y, wg->w, wg->h };
+
+  for (int16_t p = wg->parent; p != WIDGET_NO_PARENT; p = tree->widgets[p].parent) {
+    r.x += tree->widgets[p].x;
+    r.y += tree->widgets[p].y;
+  }
+  return r;
+}
+
+// Position of the value in the range, 0 .. scale
+static int32_t
+widget_scale(widget_t *wg, int32_t scale)
+{
+  if (wg->max <= wg->min) {
+    return 0;
+  }
+  if (wg->value <= wg->min) {
+    return 0;
+  }
+  if (wg->value >= wg->max) {
+    return scale;
+  }
+  return (int64_t)(wg->value - wg->min) * scale / (wg->max - wg->min);
+}
+
+static void
+draw_gauge(tinygrafx_t tg, widget_t *wg, tinygrafx_rect_t r)
+{
+  int16_t cx = r.x + r.w / 2;
+  int16_t cy = r.y + r.h - 1;
+  int16_t radius = (r.w / 2 - 1 < r.h - 1) ? (r.w / 2 - 1) : (r.h - 1);
+  int16_t x0 = cx - radius, y0 = cy, x1, y1;
+
+  // upper half circle from the min (left) to the max (right)
+  for (int16_t i = 1; i <= GAUGE_ARC_STEPS; i++) {
+    float a = (float)M_PI * i / GAUGE_ARC_STEPS;
+    x1 = cx - lroundf(radius * cosf(a));
+    y1 = cy - lroundf(radius * sinf(a));
+    draw_line(tg, x0, y0, x1, y1, WHITE);
+    x0 = x1;
+    y0 = y1;
+  }
+
+  float a = (float)M_PI * widget_scale(wg, 1000) / 1000;
+  draw_line(tg, cx, cy, cx - lroundf((radius - 2) * cosf(a)), cy - lroundf((radius - 2) * sinf(a)), WHITE);
+}
+
+static void
+draw_bitmap(tinygrafx_t tg, const uint8_t *bitmap, tinygrafx_rect_t r)
+{
+  for (int16_t y = 0; y < r.h; y++) {
+    for (int16_t x = 0; x < r.w; x++) {
+      if ((bitmap[x + (y / 8) * r.w] >> (y & 7)) & 1) {
+        set_pixel(tg, r.x + x, r.y + y, WHITE);
+      }
+    }
+  }
+}
+
+static void
+widget_draw(tinygrafx_t tg, widget_t *wg, tinygrafx_rect_t r)
+{
+  char text[16];
+  int16_t len;
+
+  switch (wg->type) {
+    case WIDGET_PANEL:
+      draw_rect(tg, r.x, r.y, r.w, r.h, WHITE);
+      break;
+    case WIDGET_LABEL:
+      len = strlen(wg->text);
+      if (len > r.w / tg.font_width) {
+        len = r.w / tg.font_width;
+      }
+      display_text(tg, r.x, r.y, (uint8_t *)wg->text, len, WHITE, 1);
+      break;
+    case WIDGET_NUMBER:
+      // right aligned, '#' in all cells if it does not fit
+      len = snprintf(text, sizeof(text), "%ld", (long)wg->value);
+      if (len > r.w / tg.font_width) {
+        len = r.w / tg.font_width;
+        memset(text, '#', len);
+      }
+      display_text(tg, r.x + r.w - len * tg.font_width, r.y, (uint8_t *)text, len, WHITE, 1);
+      break;
+    case WIDGET_BAR:
+      draw_rect(tg, r.x, r.y, r.w, r.h, WHITE);
+      draw_fill_rect(tg, r.x + 2, r.y + 2, widget_scale(wg, r.w - 4), r.h - 4, WHITE);
+      break;
+    case WIDGET_GAUGE:
+      draw_gauge(tg, wg, r);
+      break;
+    case WIDGET_ICON:
+      if (wg->bitmap != NULL) {
+        draw_bitmap(tg, wg->bitmap, r);
+      }
+      break;
+  }
+}
+
+// Add a damaged rectangle, merged with the overlapping ones until none
+// overlaps. If the list is full, the last one is merged to make room.
+static void
+damage_add(tinygrafx_rect_t *damage, uint8_t *count, tinygrafx_rect_t r)
+{
+  bool merged = true;
+
+  while (merged) {
+    merged = false;
+    for (uint8_t i = 0; i < *count; i++) {
+      tinygrafx_rect_t *d = &damage[i];
+      if ((r.x <= d->x + d->w) && (d->x <= r.x + r.w) && (r.y <= d->y + d->h) && (d->y <= r.y + r.h)) {
+        rect_union(&r, d);
+        *d = damage[--(*count)];
+        merged = true;
+        break;
+      }
+    }
+    if (!merged && (*count == WIDGET_MAX_DAMAGE)) {
+      rect_union(&r, &damage[--(*count)]);
+      merged = true;
+    }
+  }
+  damage[(*count)++] = r;
+}
+
+// Redraw the dirty widgets and their children.
+// damage must have WIDGET_MAX_DAMAGE entries. Returns the number of
+// damaged rectangles.
+uint8_t
+widget_render(widget_tree_t *tree, tinygrafx_t tg, tinygrafx_rect_t *damage)
+{
+  uint8_t count = 0;
+
+  for (int16_t i = 0; i < tree->count; i++) {
+    widget_t *wg = &tree->widgets[i];
+    bool parent_redraw = (wg->parent != WIDGET_NO_PARENT) && tree->widgets[wg->parent].redraw;
+    wg->redraw = wg->dirty || parent_redraw;
+    if (!wg->redraw) {
+      continue;
+    }
+
+    tinygrafx_rect_t r = widget_bounds(tree, wg);
+    // a child is in the area cleared and damaged by the parent already
+    if (!parent_redraw) {
+      draw_fill_rect(tg, r.x, r.y, r.w, r.h, BLACK);
+      damage_add(damage, &count, r);
+    }
+    widget_draw(tg, wg, r);
+    wg->dirty = false;
+  }
+  return count;
+}
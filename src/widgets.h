@@ -0,0 +1,49 @@
+#ifndef WIDGETSH_
+#define WIDGETSH_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tiny_grafx.h"
+
+// Widget types
+#define WIDGET_PANEL    0
+#define WIDGET_LABEL    1
+#define WIDGET_NUMBER   2
+#define WIDGET_BAR      3
+#define WIDGET_GAUGE    4
+#define WIDGET_ICON     5
+
+#define WIDGET_NO_PARENT  -1
+#define WIDGET_TEXT_SIZE  24
+#define WIDGET_MAX_DAMAGE 8
+
+// Widget, the position is relative to the parent widget
+typedef struct widget_t {
+  uint8_t type;
+  int16_t parent;           // parent widget id, or WIDGET_NO_PARENT
+  bool dirty;               // the value was changed
+  bool redraw;              // redrawn in this render
+  int16_t x, y, w, h;
+  int32_t value;
+  int32_t min, max;         // range of the bar and the gauge
+  char text[WIDGET_TEXT_SIZE];
+  uint8_t *bitmap;          // icon bitmap in the frame buffer layout
+} widget_t;
+
+typedef struct widget_tree_t {
+  widget_t *widgets;
+  int16_t count;
+  int16_t capacity;
+} widget_tree_t;
+
+void widget_tree_init(widget_tree_t *tree);
+void widget_tree_free(widget_tree_t *tree);
+int16_t widget_add(widget_tree_t *tree, uint8_t type, int16_t parent, int16_t x, int16_t y, int16_t w, int16_t h);
+bool widget_set_value(widget_tree_t *tree, int16_t id, int32_t value);
+bool widget_set_range(widget_tree_t *tree, int16_t id, int32_t min, int32_t max);
+bool widget_set_text(widget_tree_t *tree, int16_t id, const char *text, int16_t length);
+bool widget_set_bitmap(widget_tree_t *tree, int16_t id, const uint8_t *bitmap, uint32_t size);
+void widget_invalidate(widget_tree_t *tree);
+uint8_t widget_render(widget_tree_t *tree, tinygrafx_t tg, tinygrafx_rect_t *damage);
+
+#endif /* WIDGETSH_ */
@@ -0,0 +1,55 @@
+// ===================================================================
+//
+//    Drawing benchmark of tiny_grafx on a host
+//
+// ===================================================================
+//
+// Draws a 128x64 frame 20000 times, and prints the time and the hash
+// of the last frame (the same in both builds).
+//
+//   runtime geometry:
+//     cc -O2 -Isrc tools/bench_grafx.c src/tiny_grafx.c -lm -o bench && ./bench
+//   fixed geometry (SSD1306_FIXED_GEOMETRY=128x64):
+//     cc -O2 -Isrc -DTG_WIDTH=128 -DTG_HEIGHT=64 tools/bench_grafx.c src/tiny_grafx.c -lm -o bench_fixed && ./bench_fixed
+//
+// ===================================================================
+
+#include <stdio.h>
+#include <time.h>
+#include "tiny_grafx.h"
+
+#define BENCH_FRAMES  20000
+
+int
+main(void)
+{
+  static uint8_t buffer[128 * 8];
+  tinygrafx_t tg = {
+    .display_width = 128,
+    .display_height = 64,
+    .display_pages = 8,
+    .display_pixel = sizeof(buffer),
+    .font_width = 8,
+    .font_height = 8,
+    .display_buffer = buffer
+  };
+  struct timespec start, end;
+  uint32_t hash = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int n = 0; n < BENCH_FRAMES; n++) {
+    buffer_clear(tg);
+    draw_fill_rect(tg, 3, 3, 60, 40, WHITE);
+    draw_circle(tg, 64, 32, 30, INVERT);
+    draw_line(tg, 0, 0, 127, 63, WHITE);
+    display_text(tg, 0, 50, (uint8_t *)"Hello world", 11, WHITE, 1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  for (int16_t page = 0; page < tg.display_pages; page++) {
+    hash = hash * 31 + buffer_page_hash(tg, page);
+  }
+  printf("%d frames: %.1f ms, hash %08x\n", BENCH_FRAMES,
+         (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6, hash);
+  return 0;
+}
@@ -0,0 +1,177 @@
+#!/usr/bin/env ruby
+#
+# Replay the frames recorded by OLED::SSD1306SPI#recording on a host.
+#
+#   ruby oled_replay.rb recording.bin out.gif      # animated GIF
+#   ruby oled_replay.rb recording.bin out_dir/     # PNG per frame
+#   ruby oled_replay.rb recording.bin              # statistics only
+#
+require 'zlib'
+
+RECORD_KEYFRAME = 0x01
+RECORD_HEADER_SIZE = 8
+DUMP_HEADER_SIZE = 12
+
+# XOR-delta run-length decoder, same format as src/frame_recorder.c
+def decode_delta(payload, frame)
+  pos = 0
+  i = 0
+  while i < payload.bytesize
+    c = payload.getbyte(i)
+    i += 1
+    run = (c & 0x7F) + 1
+    if c & 0x80 != 0
+      run.times do |j|
+        frame[pos + j] ^= payload.getbyte(i + j)
+      end
+      i += run
+    end
+    pos += run
+  end
+  raise "broken record" if pos != frame.size
+end
+
+def read_recording(data)
+  magic, version, pages, width, count = data.unpack('a4CCvV')
+  raise "not a recording" if magic != 'OREC' || version != 1
+
+  frames = []
+  frame = nil
+  offset = DUMP_HEADER_SIZE
+  count.times do
+    flags, _, len, time = data.unpack("@#{offset}CCvV")
+    payload = data.byteslice(offset + RECORD_HEADER_SIZE, len)
+    offset += RECORD_HEADER_SIZE + len
+
+    # older records were overwritten, start from a keyframe
+    if flags & RECORD_KEYFRAME != 0
+      frame = Array.new(width * pages, 0)
+    end
+    next if frame.nil?
+
+    decode_delta(payload, frame)
+    frames << [time, frame.dup, len + RECORD_HEADER_SIZE]
+  end
+  [width, pages * 8, frames]
+end
+
+def pixel(frame, width, x, y)
+  (frame[x + (y / 8) * width] >> (y & 7)) & 1
+end
+
+def png_chunk(type, body)
+  [body.bytesize].pack('N') + type + body + [Zlib.crc32(type + body)].pack('N')
+end
+
+def write_png(path, width, height, frame)
+  rows = ''.b
+  height.times do |y|
+    rows << 0
+    (0...width).step(8) do |x|
+      byte = 0
+      8.times do |b|
+        byte |= 0x80 >> b if x + b < width && pixel(frame, width, x + b, y) == 1
+      end
+      rows << byte
+    end
+  end
+  png = "\x89PNG\r\n\x1A\n".b
+  png << png_chunk('IHDR', [width, height, 1, 0, 0, 0, 0].pack('NNCCCCC'))
+  png << png_chunk('IDAT', Zlib::Deflate.deflate(rows))
+  png << png_chunk('IEND', '')
+  File.binwrite(path, png)
+end
+
+# GIF LZW encoder, LSB-first codes
+def lzw_encode(pixels, min_size = 2)
+  clear = 1 << min_size
+  eoi = clear + 1
+  out = ''.b
+  acc = 0
+  nbits = 0
+  put = lambda do |code, size|
+    acc |= code << nbits
+    nbits += size
+    while nbits >= 8
+      out << (acc & 0xFF)
+      acc >>= 8
+      nbits -= 8
+    end
+  end
+
+  size = min_size + 1
+  dict = {}
+  next_code = eoi + 1
+  put.call(clear, size)
+  prefix = pixels[0]
+  pixels.drop(1).each do |px|
+    key = (prefix << 8) | px
+    if dict.key?(key)
+      prefix = dict[key]
+      next
+    end
+    put.call(prefix, size)
+    if next_code < 4096
+      dict[key] = next_code
+      size += 1 if next_code == (1 << size) && size < 12
+      next_code += 1
+    else
+      put.call(clear, size)
+      dict.clear
+      size = min_size + 1
+      next_code = eoi + 1
+    end
+    prefix = px
+  end
+  put.call(prefix, size)
+  size += 1 if next_code == (1 << size) && size < 12
+  put.call(eoi, size)
+  out << acc if nbits > 0
+
+  blocks = [min_size].pack('C')
+  out.bytes.each_slice(255) { |s| blocks << [s.size].pack('C') << s.pack('C*') }
+  blocks << "\x00"
+end
+
+def write_gif(path, width, height, frames)
+  gif = 'GIF89a'.b
+  gif << [width, height, 0x80, 0, 0].pack('vvCCC')
+  gif << "\x00\x00\x00\xFF\xFF\xFF".b
+  gif << "\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00".b
+  frames.each_with_index do |(time, frame, _), i|
+    next_time = (i + 1 < frames.size) ? frames[i + 1][0] : time + 100
+    delay = [(next_time - time) / 10, 2].max
+    gif << [0x21, 0xF9, 4, 0, delay, 0, 0].pack('CCCCvCC')
+    gif << [0x2C, 0, 0, width, height, 0].pack('CvvvvC')
+    pixels = []
+    height.times { |y| width.times { |x| pixels << pixel(frame, width, x, y) } }
+    gif << lzw_encode(pixels)
+  end
+  gif << "\x3B"
+  File.binwrite(path, gif)
+end
+
+if ARGV.empty?
+  warn "usage: #{$0} recording.bin [out.gif | out_dir/]"
+  exit 1
+end
+
+width, height, frames = read_recording(File.binread(ARGV[0]))
+encoded = frames.sum { |f| f[2] }
+raw = frames.size * width * height / 8
+puts "#{width}x#{height}, #{frames.size} frames"
+if raw > 0
+  puts "raw #{raw} bytes, encoded #{encoded} bytes, ratio #{format('%.1f', raw.to_f / encoded)}:1"
+end
+
+out = ARGV[1]
+if out.nil?
+  # statistics only
+elsif out.end_with?('.gif')
+  write_gif(out, width, height, frames)
+else
+  Dir.mkdir(out) unless Dir.exist?(out)
+  frames.each_with_index do |(_, frame, _), i|
+    write_png(File.join(out, format('frame_%05d.png', i)), width, height, frame)
+  end
+end
@@ -0,0 +1,145 @@
+// ===================================================================
+//
+//    Host test of the mock display and the frame recorder
+//
+// ===================================================================
+//
+// Draws an animation, writes each frame to a mock SPI display and
+// records it. Checks that the mock received each frame, and that the
+// recording replays the frames kept in the ring buffer. Prints the
+// compression ratio of the recording. Exits with 1 if failed.
+//
+//   cc -O2 -Isrc -o test_mock_recorder tools/test_mock_recorder.c src/ssd1306.c
+//      src/transport_mock.c src/tiny_grafx.c src/frame_recorder.c -lm
+//   ./test_mock_recorder
+//
+// ===================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include "ssd1306.h"
+#include "frame_recorder.h"
+
+#define TEST_FRAMES     100
+#define FRAME_SIZE      (128 * 8)
+#define RING_SIZE       4096    // the older records are overwritten
+#define KEYFRAME_EVERY  32
+
+static uint8_t frames[TEST_FRAMES][FRAME_SIZE];
+
+// The data of the last data transaction in the traffic log
+static const uint8_t *
+mock_last_data(const oled_mock_t *mock, uint32_t *len)
+{
+  const uint8_t *data = NULL;
+
+  for (uint32_t i = 0; i + 3 <= mock->log_used; ) {
+    uint32_t n = mock->log[i + 1] | (mock->log[i + 2] << 8);
+    if (mock->log[i] == OLED_MOCK_DATA) {
+      data = mock->log + i + 3;
+      *len = n;
+    }
+    i += 3 + n;
+  }
+  return data;
+}
+
+// Replay the recording, the frames before the first keyframe kept are skipped.
+// Returns the number of frames checked, -1 if a frame differs.
+static int
+replay(const frame_recorder_t *rec)
+{
+  static uint8_t dump[RING_SIZE];
+  uint8_t frame[FRAME_SIZE];
+  uint32_t size = frame_recorder_read(rec, dump, sizeof(dump));
+  uint32_t first = rec->frames - rec->records;
+  bool started = false;
+  int checked = 0;
+
+  for (uint32_t offset = 0, n = first; offset < size; n++) {
+    uint8_t flags = dump[offset];
+    uint32_t len = dump[offset + 2] | (dump[offset + 3] << 8);
+    const uint8_t *payload = dump + offset + FRAME_RECORD_HEADER_SIZE;
+    offset += FRAME_RECORD_HEADER_SIZE + len;
+
+    if (flags & FRAME_RECORD_KEYFRAME) {
+      memset(frame, 0, sizeof(frame));
+      started = true;
+    }
+    if (!started) {
+      continue;
+    }
+    if (!frame_delta_decode(payload, len, frame, sizeof(frame)) || (memcmp(frame, frames[n], sizeof(frame)) != 0)) {
+      printf("frame %u differs on replay\n", n);
+      return -1;
+    }
+    checked++;
+  }
+  return checked;
+}
+
+int
+main(void)
+{
+  static uint8_t buffer[FRAME_SIZE];
+  tinygrafx_t tg = {
+    .display_width = 128,
+    .display_height = 64,
+    .display_pages = 8,
+    .display_pixel = FRAME_SIZE,
+    .font_width = 8,
+    .font_height = 8,
+    .display_buffer = buffer
+  };
+  ssd1306_t panel = {
+    .controller = CTRL_SSD1306,
+    .width = 128,
+    .height = 64,
+    .pages = 8,
+    .contrast = 0x7F,
+    .power = true
+  };
+  frame_recorder_t rec;
+  char text[16];
+
+  panel.bus = oled_mock_create(OLED_BUS_SPI, 10000000, 20000, 4096);
+  oled_mock_t *mock = (oled_mock_t *)panel.bus;
+  if ((panel.bus == NULL) || (ssd1306_init(&panel) != XFER_OK) ||
+      !frame_recorder_init(&rec, FRAME_SIZE, RING_SIZE, KEYFRAME_EVERY)) {
+    printf("cannot start\n");
+    return 1;
+  }
+
+  for (int n = 0; n < TEST_FRAMES; n++) {
+    buffer_clear(tg);
+    draw_rect(tg, 0, 0, 128, 64, WHITE);
+    draw_fill_circle(tg, 10 + n, 32, 8, WHITE);
+    int len = snprintf(text, sizeof(text), "frame %d", n);
+    display_text(tg, 4, 4, (uint8_t *)text, len, WHITE, 1);
+
+    uint32_t sent = 0, data_len = 0;
+    oled_mock_clear(mock);
+    if (ssd1306_write_frame(&panel, buffer, NULL, 0, &sent) != XFER_OK) {
+      printf("frame %d is not sent\n", n);
+      return 1;
+    }
+    const uint8_t *data = mock_last_data(mock, &data_len);
+    if ((data == NULL) || (data_len != FRAME_SIZE) || (memcmp(data, buffer, FRAME_SIZE) != 0)) {
+      printf("frame %d differs on the mock\n", n);
+      return 1;
+    }
+    frame_recorder_add(&rec, buffer, n * 50);
+    memcpy(frames[n], buffer, FRAME_SIZE);
+  }
+
+  int checked = replay(&rec);
+  if (checked <= 0) {
+    return 1;
+  }
+  printf("%d frames sent, %u kept, %d replayed, compression %.1f:1 (%u -> %u bytes)\n",
+         TEST_FRAMES, rec.records, checked, (double)rec.raw_bytes / rec.encoded_bytes,
+         rec.raw_bytes, rec.encoded_bytes);
+  frame_recorder_deinit(&rec);
+  oled_transport_free(panel.bus);
+  return 0;
+}